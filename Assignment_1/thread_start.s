@@ -1,20 +1,60 @@
 # Context switching function:
 # thread_start(old,new)
+#
+# The .cfi_ lines describe the stack frame to debuggers, profilers and
+# anything else that unwinds the stack (see thread_switch.s). new's stack is
+# empty, so once we are on it, this is the outermost frame of the new thread:
+# the return address is marked undefined, which is where unwinders stop, and
+# %rbp is zeroed, which is where frame pointer walks stop. thread_wrap is
+# called rather than jumped to, so that it has a return address for them to
+# find; that also means new's stack pointer must start out 16-byte aligned.
+#
+# thread_begin is the second half on its own, for a thread that is started
+# by thread_switch rather than thread_start: give it a stack that holds six
+# zeroed registers followed by the address of thread_begin, with that
+# address in the top 8 bytes of the aligned stack, and thread_switch's ret
+# lands here with the stack pointer aligned.
+.text
 .globl thread_start
+.globl thread_begin
+.type thread_start, @function
 
 thread_start:
+    .cfi_startproc
     pushq %rbx # Push
+    .cfi_adjust_cfa_offset 8
+    .cfi_rel_offset %rbx, 0
     pushq %rbp # all
+    .cfi_adjust_cfa_offset 8
+    .cfi_rel_offset %rbp, 0
     pushq %r12 # callee-save
+    .cfi_adjust_cfa_offset 8
+    .cfi_rel_offset %r12, 0
     pushq %r13 # registers
+    .cfi_adjust_cfa_offset 8
+    .cfi_rel_offset %r13, 0
     pushq %r14 # onto the
+    .cfi_adjust_cfa_offset 8
+    .cfi_rel_offset %r14, 0
     pushq %r15 # stack
+    .cfi_adjust_cfa_offset 8
+    .cfi_rel_offset %r15, 0
 
     # Save current stack pointer in old's TCB
     movq %rsp,(%rdi)
 
     # Load stack pointer from new's TCB into %rsp
     movq (%rsi),%rsp
+    .cfi_undefined %rip
 
-    jmp thread_wrap
+thread_begin:
+    # Mark the outermost frame and start the thread
+    xorl %ebp,%ebp
+    call thread_wrap
 
+    # thread_wrap must never return
+    ud2
+    .cfi_endproc
+.size thread_start, .-thread_start
+
+.section .note.GNU-stack,"",@progbits
@@ -1,14 +1,34 @@
 # Context switching function:
 # thread_switch(old,new)
+#
+# The .cfi_ lines describe the stack frame to debuggers, profilers and
+# anything else that unwinds the stack. Both stacks hold the same six
+# registers and return address at the same offsets, so the same description
+# holds before the switch (for old's stack) and after it (for new's).
+.text
 .globl thread_switch
+.type thread_switch, @function
 
 thread_switch:
+    .cfi_startproc
     pushq %rbx # Push
+    .cfi_adjust_cfa_offset 8
+    .cfi_rel_offset %rbx, 0
     pushq %rbp # all
+    .cfi_adjust_cfa_offset 8
+    .cfi_rel_offset %rbp, 0
     pushq %r12 # callee-save
+    .cfi_adjust_cfa_offset 8
+    .cfi_rel_offset %r12, 0
     pushq %r13 # registers
+    .cfi_adjust_cfa_offset 8
+    .cfi_rel_offset %r13, 0
     pushq %r14 # onto the
+    .cfi_adjust_cfa_offset 8
+    .cfi_rel_offset %r14, 0
     pushq %r15 # stack
+    .cfi_adjust_cfa_offset 8
+    .cfi_rel_offset %r15, 0
 
     # Save current stack pointer in old's TCB
     movq %rsp,(%rdi)
@@ -17,11 +37,26 @@ thread_switch:
     movq (%rsi),%rsp
 
     popq %r15 # Pop
+    .cfi_adjust_cfa_offset -8
+    .cfi_restore %r15
     popq %r14 # all
+    .cfi_adjust_cfa_offset -8
+    .cfi_restore %r14
     popq %r13 # callee-save
+    .cfi_adjust_cfa_offset -8
+    .cfi_restore %r13
     popq %r12 # registers
+    .cfi_adjust_cfa_offset -8
+    .cfi_restore %r12
     popq %rbp # from the
+    .cfi_adjust_cfa_offset -8
+    .cfi_restore %rbp
     popq %rbx # new stack (in reverse)
+    .cfi_adjust_cfa_offset -8
+    .cfi_restore %rbx
 
     ret
+    .cfi_endproc
+.size thread_switch, .-thread_switch
 
+.section .note.GNU-stack,"",@progbits
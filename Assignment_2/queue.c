@@ -47,6 +47,23 @@ struct thread * thread_dequeue(struct queue * q) {
 
 }
 
+void thread_enqueue_all(struct queue * q, struct queue * from) {
+
+  if(!from->head) {
+    return;
+  }
+
+  if(!q->head) {
+    q->head = from->head;
+  } else {
+    q->tail->next = from->head;
+  }
+  q->tail = from->tail;
+
+  from->head = from->tail = NULL;
+
+}
+
 int is_empty(struct queue * q) {
   return !q->head;
 }
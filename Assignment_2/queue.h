@@ -19,4 +19,10 @@ struct queue {
 
 void thread_enqueue(struct queue * q, struct thread * t);
 struct thread * thread_dequeue(struct queue * q);
+
+/* Moves every thread in from to the end of q, in order, and leaves from
+ * empty. No nodes are allocated or freed, so it takes the same time however
+ * long from is: handy for waking a whole waiting queue at once. */
+void thread_enqueue_all(struct queue * q, struct queue * from);
+
 int is_empty(struct queue * q);
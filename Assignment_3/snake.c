@@ -19,12 +19,13 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 
 #include "scheduler.h"  /* our scheduler! */
 
-#include <stdio.h>      /* printf */
-#include <string.h>     /* memset */
-#include <unistd.h>     /* close, usleep */
+#include <stdio.h>      /* printf, sprintf */
+#include <string.h>     /* memset, memcpy */
+#include <unistd.h>     /* usleep, write, close */
 #include <stdlib.h>     /* rand */
+#include <errno.h>      /* errno, EAGAIN */
+#include <time.h>       /* clock_gettime */
 
-#include <sys/ioctl.h>  /* ioctl, TIOCGWINSZ */
 #include <fcntl.h>      /* open */
 
 #include <termios.h>    /* tcgetattr, tcsetattr */
@@ -47,19 +48,45 @@ void restore_term_state() {
   tcsetattr(0, TCSANOW, &old);
 }
 
-/* Get screen height
- * see ioctl(2) for info 
- * also: http://rosettacode.org/wiki/Terminal_control/Dimensions#C
+/* Open the terminal for drawing on
+ * The board is drawn through a file descriptor of its own, opened
+ * non-blocking, so that a slow terminal makes the render thread yield
+ * instead of stopping every thread. Setting O_NONBLOCK on stdout would not
+ * do: it usually shares its open file with stdin, which the keypress
+ * listener reads. For the same reason, when there is no /dev/tty to open,
+ * the board is drawn on stdout as it is, and a slow write there blocks the
+ * whole kernel thread.
+ * see open(2) for info
  */
-int screen_height;
-void set_screensize() {
-  struct winsize ws;
+int term_fd = -1;
+void open_terminal() {
+  term_fd = open("/dev/tty", O_WRONLY | O_NONBLOCK);
+  if(term_fd < 0) {
+    term_fd = 1;
+  }
+}
 
-  int term = open("/dev/tty", O_RDWR); 
-  ioctl(term, TIOCGWINSZ, &ws);
-  close(term);  
+void close_terminal() {
+  if(term_fd != 1) {
+    close(term_fd);
+  }
+  term_fd = -1;
+}
 
-  screen_height = ws.ws_row;
+/* Write all of buf, yielding whenever the terminal can't take any more */
+int write_frame(const char * buf, int count) {
+  int done = 0;
+  while(done < count) {
+    ssize_t n = write(term_fd, buf + done, count - done);
+    if(n >= 0) {
+      done += n;
+    } else if(errno == EAGAIN || errno == EWOULDBLOCK) {
+      yield();
+    } else if(errno != EINTR) {
+      return -1;
+    }
+  }
+  return done;
 }
 
 
@@ -101,31 +128,96 @@ void initialize_board() {
   set_point(snake[0]);
 }
 
-void print_board(void) {
-  int i, j;
+/* Render State
+ * front is what the terminal is showing, and back is the frame being drawn.
+ * Each frame copies board into back, moves the cursor (with ANSI escape
+ * codes) only to the cells where back differs from front, and sends the
+ * whole frame with one write. The first frame clears the screen and draws
+ * everything, border included. Board cell (i, j) is at row i + 2, column
+ * j + 2 of the screen, counting from 1, and the cursor is left on the row
+ * below the board.
+ */
+char frames[2][HEIGHT][WIDTH];
+char (*front)[WIDTH] = frames[0];
+char (*back)[WIDTH] = frames[1];
+int drawn = 0;
+
+/* Worst case: a cursor move and a character for every cell */
+#define FRAME_MAX ((HEIGHT + 2) * (WIDTH + 2) * 12 + 64)
+char frame[FRAME_MAX];
+
+/* Stats, reported at the end of the game */
+long frames_drawn = 0;
+long bytes_written = 0;
+double render_ns = 0;
+
+double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
 
-  for(i = 0; i < screen_height - (HEIGHT + 2); ++i) {
-    printf("\n");
-  }
+int move_cursor(char * out, int row, int col) {
+  return sprintf(out, "\033[%d;%dH", row, col);
+}
 
-  for(i = 0; i < WIDTH + 2; ++i) {
-    printf("*");
-  }
-  printf("\n");
-  
-  for(i = 0; i < HEIGHT; ++i) {
-    printf("*");
-    for(j = 0; j < WIDTH; ++j) {
-      printf("%c", board[i][j]);
+void print_board(void) {
+  int i, j, len = 0;
+  int row = 0, col = 0;   /* where the cursor is, if known */
+  double start = now_ns();
+
+  memcpy(back, board, HEIGHT * WIDTH);
+
+  if(!drawn) {
+    len += sprintf(frame + len, "\033[2J\033[H");
+    for(i = 0; i < HEIGHT + 2; ++i) {
+      len += move_cursor(frame + len, i + 1, 1);
+      for(j = 0; j < WIDTH + 2; ++j) {
+        int border = i == 0 || i == HEIGHT + 1 || j == 0 || j == WIDTH + 1;
+        frame[len++] = border ? '*' : back[i - 1][j - 1];
+      }
+    }
+    drawn = 1;
+  } else {
+    for(i = 0; i < HEIGHT; ++i) {
+      for(j = 0; j < WIDTH; ++j) {
+        if(back[i][j] == front[i][j]) {
+          continue;
+        }
+        if(row != i + 2 || col != j + 2) {
+          len += move_cursor(frame + len, i + 2, j + 2);
+        }
+        frame[len++] = back[i][j];
+        row = i + 2;
+        col = j + 3;
+      }
     }
-    printf("*\n");
   }
 
-  for(i = 0; i < WIDTH + 2; ++i) {
-    printf("*");
+  if(len > 0) {
+    len += move_cursor(frame + len, HEIGHT + 3, 1);
+    if(write_frame(frame, len) == len) {
+      bytes_written += len;
+    }
   }
-  printf("\n");
 
+  char (*temp)[WIDTH] = front;
+  front = back;
+  back = temp;
+
+  ++frames_drawn;
+  render_ns += now_ns() - start;
+}
+
+/* A full redraw sends every cell and the border every frame */
+void print_render_stats(void) {
+  if(frames_drawn == 0) {
+    return;
+  }
+  printf("%ld frames: %.0f bytes and %.1f us per frame "
+         "(a full redraw is %d bytes)\n",
+         frames_drawn, (double)bytes_written / frames_drawn,
+         render_ns / frames_drawn / 1e3, (HEIGHT + 2) * (WIDTH + 3));
 }
 
 typedef enum {
@@ -225,7 +317,7 @@ void game_loop(void * arg) {
 void begin_game(void * arg) {
   set_term_state();
 
-  set_screensize();
+  open_terminal();
   initialize_board();
 
   thread_fork(game_loop, listen_for_keypress);
@@ -240,8 +332,10 @@ void begin_game(void * arg) {
   }
 
   print_board();
-  printf("game over! your score: %d\n"
-         "press any key to exit\n", snake_head - snake_tail );
+  close_terminal();
+  printf("game over! your score: %d\n", snake_head - snake_tail);
+  print_render_stats();
+  printf("press any key to exit\n");
 
   /* might already be waiting for a keypress.. if not, wait now */
   if(!waiting_for_key) {
@@ -0,0 +1,182 @@
+/* CS533 Assignment 5
+ * affine.c: Waking threads up on the kernel thread they last ran on
+ *
+ * Each kernel thread's queue is tagged with the ready list its kernel thread
+ * takes threads from, so that with several scheduler instances, a thread is
+ * only ever put on, or taken from, a queue that is protected by the ready
+ * list lock its caller holds. A thread that moved to another instance no
+ * longer matches the tag of its old kernel thread's queue, and goes on the
+ * ready list.
+ *
+ * A queued thread is not kept for its kernel thread forever: that kernel
+ * thread may be blocked in a system call, parked by elastic_idle, or busy
+ * with a thread that never yields. Once a thread has waited on another
+ * kernel thread's queue for longer than the migration cost, its data is
+ * likely out of that cache anyway, and any kernel thread takes it ahead of
+ * the ready list. Queues are first in, first out, so only the first thread
+ * of each needs looking at.
+ *
+ * The migration counters are only changed with the ready list lock held,
+ * but they are read without it, and kept a cache line apart so that kernel
+ * threads do not write to each other's lines.
+ */
+
+#include <stdlib.h>
+#include <time.h>
+
+#include "affine.h"
+#include "scheduler.h"
+
+#ifdef AFFINE_WAKEUPS
+
+#define AFFINE_CACHE_LINE 64
+
+struct kthread_queue {
+  struct queue threads;
+  int length;
+  int streak;                    /* threads taken from here in a row */
+  struct queue * ready_list;     /* NULL until affine_kthread */
+  volatile AO_t migrations;      /* onto this kernel thread */
+};
+
+union kthread_queue_line {
+  struct kthread_queue q;
+  char pad[2 * AFFINE_CACHE_LINE];
+};
+
+static union kthread_queue_line kthreads[AFFINE_KTHREADS_MAX];
+static volatile AO_t num_kthreads;      /* highest id with a queue, plus 1 */
+static volatile long migration_cost = AFFINE_MIGRATION_COST;
+
+static long now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+void affine_init(void) {
+  const char * env = getenv("KTHREAD_MIGRATION_COST");
+  if(env) {
+    migration_cost = atol(env);
+  }
+}
+
+long affine_migration_cost(void) {
+  return migration_cost;
+}
+
+void affine_set_migration_cost(long ns) {
+  migration_cost = ns;
+}
+
+static struct kthread_queue * queue_of(int kthread, struct queue * ready_list) {
+  if(kthread < 0 || kthread >= AFFINE_KTHREADS_MAX) {
+    return NULL;
+  }
+  struct kthread_queue * q = &kthreads[kthread].q;
+  return q->ready_list == ready_list ? q : NULL;
+}
+
+static struct thread * take(struct kthread_queue * q) {
+  --q->length;
+  return thread_dequeue(&q->threads);
+}
+
+void affine_thread_init(struct thread * t) {
+  t->affine.kthread = -1;
+  t->affine.stopped = 0;
+  t->affine.queued = 0;
+}
+
+void affine_kthread(struct thread * t, int kthread, struct queue * ready_list) {
+  AO_t n;
+
+  t->affine.kthread = kthread;
+  if(kthread < 0 || kthread >= AFFINE_KTHREADS_MAX) {
+    return;
+  }
+  kthreads[kthread].q.ready_list = ready_list;
+  do {
+    n = AO_load_acquire(&num_kthreads);
+  } while(n <= (AO_t)kthread &&
+          !AO_compare_and_swap_full(&num_kthreads, n, kthread + 1));
+}
+
+void affine_switch(struct thread * old, struct thread * next) {
+  int k = old->affine.kthread;
+
+  if(migration_cost > 0) {
+    old->affine.stopped = now_ns();
+  }
+  if(next->affine.kthread != k && next->affine.kthread >= 0 &&
+     k >= 0 && k < AFFINE_KTHREADS_MAX) {
+    AO_store(&kthreads[k].q.migrations, kthreads[k].q.migrations + 1);
+  }
+  next->affine.kthread = k;
+}
+
+int affine_wake(struct thread * t, struct queue * ready_list) {
+  struct kthread_queue * q = queue_of(t->affine.kthread, ready_list);
+  long now;
+
+  if(!q || migration_cost <= 0 || q->length >= AFFINE_QUEUE_MAX ||
+     (now = now_ns()) - t->affine.stopped > migration_cost) {
+    return 0;
+  }
+  t->affine.queued = now;
+  thread_enqueue(&q->threads, t);
+  ++q->length;
+  return 1;
+}
+
+struct thread * affine_next(struct thread * self, struct queue * ready_list) {
+  struct kthread_queue * q = queue_of(self->affine.kthread, ready_list);
+  struct thread * t;
+  long now = 0;
+  int i, n;
+
+  if(q) {
+    if(q->length && (q->streak < AFFINE_QUEUE_MAX || is_empty(ready_list))) {
+      ++q->streak;
+      return take(q);
+    }
+    q->streak = 0;
+  }
+
+  /* threads stranded on another kernel thread's queue */
+  n = AO_load_acquire(&num_kthreads);
+  for(i = 0; i < n; ++i) {
+    struct kthread_queue * other = queue_of(i, ready_list);
+    if(other && other != q && other->length) {
+      if(!now) {
+        now = now_ns();
+      }
+      if(now - other->threads.head->t->affine.queued >= migration_cost) {
+        return take(other);
+      }
+    }
+  }
+
+  if((t = thread_dequeue(ready_list))) {
+    return t;
+  }
+
+  for(i = 0; i < n; ++i) {
+    struct kthread_queue * other = queue_of(i, ready_list);
+    if(other && other->length) {
+      return take(other);
+    }
+  }
+  return NULL;
+}
+
+unsigned long affine_migrations(void) {
+  unsigned long total = 0;
+  int i, n = AO_load_acquire(&num_kthreads);
+  for(i = 0; i < n; ++i) {
+    total += AO_load(&kthreads[i].q.migrations);
+  }
+  return total;
+}
+
+#endif
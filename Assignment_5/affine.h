@@ -0,0 +1,81 @@
+/* CS533 Assignment 5
+ * affine.h: Waking threads up on the kernel thread they last ran on
+ *
+ * With one ready list, a thread woken up by mutex_unlock, condition_signal
+ * or thread_join runs next on whichever kernel thread gets to it first, and
+ * the data it was working on is left behind in another CPU's cache. Here
+ * every kernel thread also has a short queue of its own. A woken thread goes
+ * on the queue of the kernel thread it last ran on, as long as it stopped
+ * running there less than the migration cost ago and that queue is not
+ * overloaded; otherwise it goes on the ready list as before. A kernel thread
+ * looks at its own queue before the ready list, and takes threads from
+ * other kernel threads' queues when there is nothing else to run, or when
+ * they have waited there longer than the migration cost.
+ *
+ * The migration cost is how long a thread's data is expected to stay in
+ * its old CPU's caches, in nanoseconds: AFFINE_MIGRATION_COST, or
+ * KTHREAD_MIGRATION_COST if that is set. KTHREAD_MIGRATION_COST=0 puts
+ * every woken thread on the ready list, like a scheduler without this.
+ *
+ * All of these functions except affine_init and the migration cost ones are
+ * called with the ready list lock held, which also protects the queues of
+ * the kernel threads that take threads from that ready list.
+ *
+ * See the "Cache-Affine Wakeups" section of README.md for what to add to
+ * your scheduler; this file is only compiled if scheduler.h defines
+ * AFFINE_WAKEUPS.
+ */
+
+#ifndef AFFINE_H
+#define AFFINE_H
+
+#define AFFINE_KTHREADS_MAX    256     /* kernel threads past this get no queue */
+#define AFFINE_QUEUE_MAX       4       /* a queue this long is overloaded */
+#define AFFINE_MIGRATION_COST  500000  /* ns */
+
+struct thread;
+struct queue;
+
+/* Goes in struct thread, as a field called affine */
+struct affine {
+  int kthread;                   /* where it runs or last ran, or -1 */
+  long stopped;                  /* when it last stopped running, in ns */
+  long queued;                   /* when affine_wake queued it, in ns */
+};
+
+/* Read KTHREAD_MIGRATION_COST. Call once from scheduler_begin. */
+void affine_init(void);
+
+long affine_migration_cost(void);
+void affine_set_migration_cost(long ns);
+
+/* Call on every new TCB. For the initial thread of a kernel thread, call
+ * affine_kthread as well, with the kernel thread's id and the ready list it
+ * takes threads from. */
+void affine_thread_init(struct thread * t);
+void affine_kthread(struct thread * t, int kthread, struct queue * ready_list);
+
+/* Call just before switching from old to next, whether with thread_switch
+ * or thread_start. Counts a migration if next last ran on another kernel
+ * thread. */
+void affine_switch(struct thread * old, struct thread * next);
+
+/* Put t, which is being woken up, on the queue of the kernel thread it last
+ * ran on and return 1, or return 0 and leave it to the caller to put it on
+ * ready_list. t->state must already be READY. */
+int affine_wake(struct thread * t, struct queue * ready_list);
+
+/* The next thread for self's kernel thread to run, in place of
+ * thread_dequeue(ready_list): from its own queue, then a thread that has
+ * waited on another kernel thread's queue longer than the migration cost,
+ * then the ready list, then any other kernel thread's queue. Every
+ * AFFINE_QUEUE_MAX threads from its own queue in a row, it looks past it
+ * first, so that threads on the ready list are not starved. A thread on the
+ * queue of a kernel thread that stopped scheduling waits at most about the
+ * migration cost. NULL if all are empty. */
+struct thread * affine_next(struct thread * self, struct queue * ready_list);
+
+/* Migrations counted so far by affine_switch, over all kernel threads */
+unsigned long affine_migrations(void);
+
+#endif
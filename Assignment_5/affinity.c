@@ -0,0 +1,224 @@
+/* CS533 Assignment 5
+ * affinity.c: Kernel thread placement on CPUs and NUMA nodes
+ *
+ * The topology comes from sysfs, so this does not need libnuma. On machines
+ * without /sys/devices/system/node, every CPU is treated as being on node 0.
+ *
+ * Node ids need not be contiguous (node0 and node2, with node1 offline), so
+ * the nodes are numbered here 0, 1, ... in the order of their ids, and that
+ * is the number every function below takes and returns. node_id maps it back
+ * to the kernel's.
+ */
+
+#define _GNU_SOURCE
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <atomic_ops.h>
+
+#include "affinity.h"
+
+#define MAX_CPUS  CPU_SETSIZE
+#define MAX_NODES 64
+
+static placement_t policy = PLACE_NONE;
+
+static int num_cpus;                   /* online CPUs */
+static int cpus[MAX_CPUS];             /* online CPUs, grouped by node */
+static int node_of_cpu[MAX_CPUS];
+
+static int nodes;
+static int node_id[MAX_NODES];         /* sysfs node%d of each node */
+static int node_first[MAX_NODES];      /* node n's CPUs are         */
+static int node_cpus[MAX_NODES];       /* cpus[node_first[n]...]    */
+static int distance[MAX_NODES][MAX_NODES];
+
+static volatile AO_t next_kthread_id;
+
+/* Parse a sysfs CPU list such as "0-3,8-11" into a set */
+static int read_cpulist(const char * path, cpu_set_t * set) {
+  FILE * f = fopen(path, "r");
+  if(!f) {
+    return 0;
+  }
+
+  CPU_ZERO(set);
+  int lo, hi;
+  while(fscanf(f, "%d", &lo) == 1) {
+    hi = lo;
+    int c = fgetc(f);
+    if(c == '-') {
+      if(fscanf(f, "%d", &hi) != 1) {
+        break;
+      }
+      c = fgetc(f);
+    }
+    for(; lo <= hi && lo < MAX_CPUS; ++lo) {
+      CPU_SET(lo, set);
+    }
+    if(c != ',') {
+      break;
+    }
+  }
+
+  fclose(f);
+  return 1;
+}
+
+void affinity_init(void) {
+  cpu_set_t online, online_nodes, on_node;
+  char path[64];
+  int cpu, id, n, m;
+
+  if(!read_cpulist("/sys/devices/system/cpu/online", &online)) {
+    CPU_ZERO(&online);
+    for(cpu = 0; cpu < sysconf(_SC_NPROCESSORS_ONLN) && cpu < MAX_CPUS; ++cpu) {
+      CPU_SET(cpu, &online);
+    }
+  }
+
+  /* without the list of online nodes, try every id rather than stopping at
+   * the first one that is missing */
+  if(!read_cpulist("/sys/devices/system/node/online", &online_nodes)) {
+    CPU_ZERO(&online_nodes);
+    for(id = 0; id < MAX_NODES; ++id) {
+      CPU_SET(id, &online_nodes);
+    }
+  }
+
+  num_cpus = 0;
+  nodes = 0;
+  for(id = 0; id < MAX_NODES; ++id) {
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", id);
+    if(!CPU_ISSET(id, &online_nodes) || !read_cpulist(path, &on_node)) {
+      continue;
+    }
+
+    n = nodes++;
+    node_id[n] = id;
+    node_first[n] = num_cpus;
+    for(cpu = 0; cpu < MAX_CPUS; ++cpu) {
+      if(CPU_ISSET(cpu, &on_node) && CPU_ISSET(cpu, &online)) {
+        node_of_cpu[cpu] = n;
+        cpus[num_cpus++] = cpu;
+      }
+    }
+    node_cpus[n] = num_cpus - node_first[n];
+  }
+
+  if(nodes == 0 || num_cpus == 0) {
+    nodes = 1;
+    num_cpus = 0;
+    node_id[0] = 0;
+    node_first[0] = 0;
+    for(cpu = 0; cpu < MAX_CPUS; ++cpu) {
+      if(CPU_ISSET(cpu, &online)) {
+        node_of_cpu[cpu] = 0;
+        cpus[num_cpus++] = cpu;
+      }
+    }
+    node_cpus[0] = num_cpus;
+  }
+
+  /* NUMA distances: 10 for a node to itself, larger means further away. Each
+   * row has one column per online node, in order of id, like ours. */
+  for(n = 0; n < nodes; ++n) {
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/distance",
+             node_id[n]);
+    FILE * f = fopen(path, "r");
+    for(m = 0; m < nodes; ++m) {
+      if(!f || fscanf(f, "%d", &distance[n][m]) != 1) {
+        distance[n][m] = n == m ? 10 : 20;
+      }
+    }
+    if(f) {
+      fclose(f);
+    }
+  }
+
+  const char * env = getenv("KTHREAD_PLACEMENT");
+  if(env) {
+    if(!strcmp(env, "compact")) {
+      policy = PLACE_COMPACT;
+    } else if(!strcmp(env, "scatter")) {
+      policy = PLACE_SCATTER;
+    } else {
+      policy = PLACE_NONE;
+    }
+  }
+}
+
+void affinity_set_policy(placement_t p) {
+  policy = p;
+}
+
+int kthread_pin(int id) {
+  int cpu;
+
+  if(policy == PLACE_NONE || num_cpus == 0) {
+    return -1;
+  }
+
+  if(policy == PLACE_COMPACT) {
+    cpu = cpus[id % num_cpus];
+  } else {
+    /* the id'th kernel thread goes to node id % nodes; skip empty nodes */
+    int n = id % nodes, k = id / nodes, tries;
+    for(tries = 0; node_cpus[n] == 0 && tries < nodes; ++tries) {
+      n = (n + 1) % nodes;
+    }
+    cpu = cpus[node_first[n] + k % node_cpus[n]];
+  }
+
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  if(sched_setaffinity(0, sizeof(set), &set) < 0) {
+    return -1;
+  }
+  return cpu;
+}
+
+int kthread_reserve(int n) {
+  return (int)AO_fetch_and_add_full(&next_kthread_id, n);
+}
+
+int num_nodes(void) {
+  return nodes;
+}
+
+int current_node(void) {
+  int cpu = sched_getcpu();
+  return cpu < 0 || cpu >= MAX_CPUS ? 0 : node_of_cpu[cpu];
+}
+
+int node_order(int node, int * order) {
+  int i, j;
+
+  for(i = 0; i < nodes; ++i) {
+    order[i] = i;
+  }
+
+  /* insertion sort by distance from node; there are only a handful */
+  for(i = 1; i < nodes; ++i) {
+    int n = order[i];
+    for(j = i; j > 0 && distance[node][order[j-1]] > distance[node][n]; --j) {
+      order[j] = order[j-1];
+    }
+    order[j] = n;
+  }
+  return nodes;
+}
+
+void * node_alloc(size_t size) {
+  void * p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  return p == MAP_FAILED ? NULL : p;
+}
+
+void node_free(void * p, size_t size) {
+  munmap(p, size);
+}
@@ -0,0 +1,60 @@
+/* CS533 Assignment 5
+ * affinity.h: Kernel thread placement on CPUs and NUMA nodes
+ *
+ * See the "Kernel Thread Placement" section of README.md for where to call
+ * these from your scheduler.
+ */
+
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+#include <stddef.h>
+
+typedef enum {
+  PLACE_NONE,     /* let Linux move kernel threads around (the default) */
+  PLACE_COMPACT,  /* pin kernel threads to CPUs, filling one node at a time */
+  PLACE_SCATTER   /* pin kernel threads to CPUs, round-robin across nodes */
+} placement_t;
+
+/* Read the CPU/node topology, and the placement policy from the
+ * KTHREAD_PLACEMENT environment variable ("none", "compact" or "scatter").
+ * Call once from scheduler_begin, before creating any kernel threads.
+ */
+void affinity_init(void);
+void affinity_set_policy(placement_t policy);
+
+/* Pin the calling kernel thread, the id'th one created by scheduler_begin
+ * (0 for the thread that called it), according to the policy. Returns the
+ * CPU it was pinned to, or -1 if the policy is PLACE_NONE.
+ */
+int kthread_pin(int id);
+
+/* Reserve n consecutive kernel thread ids and return the first. With several
+ * scheduler instances, each reserves ids for its kernel threads this way, so
+ * that they are pinned to CPUs of their own; the first reservation, for the
+ * default instance, starts at 0.
+ */
+int kthread_reserve(int n);
+
+/* Nodes are numbered 0 to num_nodes() - 1 here, in the order of the kernel's
+ * node ids, even when some of those ids are offline or unused.
+ */
+int num_nodes(void);
+
+/* NUMA node of the CPU the calling kernel thread is running on */
+int current_node(void);
+
+/* Fill order with all nodes, nearest to node first; returns num_nodes().
+ * A scheduler with one ready list per node should look for work in this
+ * order.
+ */
+int node_order(int node, int * order);
+
+/* Allocate size bytes of fresh pages. Nothing touches them here, so each page
+ * lands on the node of the kernel thread that first writes to it, rather than
+ * wherever a previously freed malloc block happened to live.
+ */
+void * node_alloc(size_t size);
+void node_free(void * p, size_t size);
+
+#endif
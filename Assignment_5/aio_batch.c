@@ -0,0 +1,478 @@
+/* CS533 Assignment 5
+ * aio_batch.c: Vectored, batched asynchronous reads with read-ahead
+ *
+ * Requests go to the kernel through an io_uring: a submission ring and a
+ * completion ring shared with the kernel, and set up once by aio_batch_init.
+ * A vectored read is a single IORING_OP_READV entry, whatever the number of
+ * buffers, and works the same on files, pipes and sockets.
+ *
+ * Submission works like this:
+ *
+ *   reader                                  any reader, later
+ *     write an entry into the ring
+ *     yield                                   ...
+ *     still not submitted? flush:
+ *       io_uring_enter(everything queued)
+ *     yield and reap until done
+ *
+ * Every reader that wrote an entry in the meantime has it submitted by the same
+ * io_uring_enter call. A prefetch is flushed right away, since nobody is
+ * waiting on it yet. Whichever thread reaps the completion ring marks the
+ * requests it finds there done, whoever they belong to.
+ *
+ * glibc's lio_listio would batch submissions as well, but it allocates memory
+ * with malloc on the calling kernel thread, and our kernel threads share the
+ * initial thread's thread-local storage, and with it malloc's per-thread
+ * cache. Doing that on one kernel thread while another is inside safe_mem
+ * corrupts the heap. io_uring needs no memory once the rings are mapped.
+ *
+ * Without io_uring (kernels before 5.1, or with it disabled), every request
+ * is made right away with readv or preadv, blocking the kernel thread.
+ *
+ * A read-ahead buffer holds at most one block, which is either being read or
+ * holds the block at [off, off + len). Only one thread at a time uses a file
+ * descriptor's read-ahead buffer; a thread that finds it in use reads
+ * directly. A reader looks the buffer up and claims it with ra_lock held, so
+ * readahead_disable, which takes it out of the table with ra_lock held too,
+ * only has to wait for the thread that already claimed it before freeing it.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "aio_batch.h"
+#include "scheduler.h"
+
+struct aio_req {
+  int fd;
+  const struct iovec * iov;
+  int iovcnt;
+  off_t offset;                  /* -1 for the current file position */
+  unsigned ticket;               /* position in the submission ring */
+  volatile AO_t done;
+  ssize_t res;                   /* bytes read, or -errno */
+};
+
+static int ring_fd = -1;
+
+/* The submission ring. Only sq_tail is ours; the kernel advances the head as
+ * it consumes entries. Protected by sq_lock.
+ */
+static struct {
+  volatile unsigned * head;
+  volatile unsigned * tail;
+  unsigned mask, entries;
+  unsigned * array;
+  struct io_uring_sqe * sqes;
+} sq;
+static unsigned sq_tail;
+static AO_TS_t sq_lock = AO_TS_INITIALIZER;
+
+/* The completion ring. Only one thread at a time reaps it, the one holding
+ * cq_lock.
+ */
+static struct {
+  volatile unsigned * head;
+  volatile unsigned * tail;
+  unsigned mask, entries;
+  struct io_uring_cqe * cqes;
+} cq;
+static AO_TS_t cq_lock = AO_TS_INITIALIZER;
+
+/* Requests submitted but not reaped, kept below the size of the completion
+ * ring so that it can never overflow
+ */
+static volatile AO_t in_flight;
+
+struct readahead {
+  AO_TS_t busy;
+  size_t block;
+  char * buf;
+  struct iovec iov;
+  struct aio_req req;
+  int in_flight;
+  off_t off;                     /* file offset of buf */
+  ssize_t len;                   /* bytes of buf that are valid */
+  off_t next;                    /* where a sequential read would start */
+};
+
+static struct readahead * ra_table[READAHEAD_MAX_FD];
+static AO_TS_t ra_lock = AO_TS_INITIALIZER;   /* protects ra_table */
+
+void aio_batch_init(void) {
+  struct io_uring_params p;
+
+  memset(&p, 0, sizeof(p));
+  ring_fd = syscall(__NR_io_uring_setup, AIO_RING_ENTRIES, &p);
+  if(ring_fd < 0) {
+    return;
+  }
+
+  size_t sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  size_t cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  if(p.features & IORING_FEAT_SINGLE_MMAP) {
+    sq_size = cq_size = sq_size > cq_size ? sq_size : cq_size;
+  }
+
+  char * sq_ring = mmap(NULL, sq_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+  char * cq_ring = sq_ring;
+  if(sq_ring != MAP_FAILED && !(p.features & IORING_FEAT_SINGLE_MMAP)) {
+    cq_ring = mmap(NULL, cq_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+  }
+  struct io_uring_sqe * sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+                                    PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                    ring_fd, IORING_OFF_SQES);
+  if(sq_ring == MAP_FAILED || cq_ring == MAP_FAILED || sqes == MAP_FAILED) {
+    perror("aio_batch: mmap");
+    close(ring_fd);
+    ring_fd = -1;
+    return;
+  }
+
+  sq.head = (unsigned *)(sq_ring + p.sq_off.head);
+  sq.tail = (unsigned *)(sq_ring + p.sq_off.tail);
+  sq.mask = *(unsigned *)(sq_ring + p.sq_off.ring_mask);
+  sq.entries = p.sq_entries;
+  sq.array = (unsigned *)(sq_ring + p.sq_off.array);
+  sq.sqes = sqes;
+  sq_tail = *sq.tail;
+
+  cq.head = (unsigned *)(cq_ring + p.cq_off.head);
+  cq.tail = (unsigned *)(cq_ring + p.cq_off.tail);
+  cq.mask = *(unsigned *)(cq_ring + p.cq_off.ring_mask);
+  cq.entries = p.cq_entries;
+  cq.cqes = (struct io_uring_cqe *)(cq_ring + p.cq_off.cqes);
+}
+
+static void setup(struct aio_req * r, int fd, const struct iovec * iov, int iovcnt,
+                  off_t offset) {
+  r->fd = fd;
+  r->iov = iov;
+  r->iovcnt = iovcnt;
+  r->offset = offset;
+  r->done = 0;
+  r->res = 0;
+}
+
+/* Hand everything in the submission ring to the kernel */
+static void flush(void) {
+  unsigned n = AO_int_load(sq.tail) - AO_int_load_acquire(sq.head);
+  if(n > 0) {
+    syscall(__NR_io_uring_enter, ring_fd, n, 0, 0, NULL, 0);
+  }
+}
+
+static int submitted(struct aio_req * r) {
+  return (int)(AO_int_load_acquire(sq.head) - r->ticket) > 0;
+}
+
+/* Mark the requests on the completion ring done, unless another thread is
+ * already at it
+ */
+static void reap(void) {
+  if(AO_test_and_set_acquire(&cq_lock) == AO_TS_SET) {
+    return;
+  }
+
+  unsigned head = *cq.head;
+  unsigned tail = AO_int_load_acquire(cq.tail);
+  while(head != tail) {
+    struct io_uring_cqe * cqe = &cq.cqes[head & cq.mask];
+    struct aio_req * r = (struct aio_req *)(uintptr_t)cqe->user_data;
+    r->res = cqe->res;
+    AO_store_release(&r->done, 1);
+    AO_fetch_and_sub1(&in_flight);
+    ++head;
+  }
+  AO_int_store_release(cq.head, head);
+  AO_CLEAR(&cq_lock);
+}
+
+static void enqueue(struct aio_req * r) {
+  if(ring_fd < 0) {
+    ssize_t n = r->offset < 0 ? readv(r->fd, r->iov, r->iovcnt)
+                              : preadv(r->fd, r->iov, r->iovcnt, r->offset);
+    r->res = n < 0 ? -errno : n;
+    r->done = 1;
+    return;
+  }
+
+  while(1) {
+    spinlock_lock(&sq_lock);
+    if(sq_tail - AO_int_load_acquire(sq.head) < sq.entries &&
+       AO_load(&in_flight) < cq.entries) {
+      unsigned index = sq_tail & sq.mask;
+      struct io_uring_sqe * sqe = &sq.sqes[index];
+
+      memset(sqe, 0, sizeof(*sqe));
+      sqe->opcode = IORING_OP_READV;
+      sqe->fd = r->fd;
+      sqe->addr = (uintptr_t)r->iov;
+      sqe->len = r->iovcnt;
+      sqe->off = r->offset;
+      sqe->user_data = (uintptr_t)r;
+      sq.array[index] = index;
+
+      r->ticket = sq_tail++;
+      AO_fetch_and_add1(&in_flight);
+      AO_int_store_release(sq.tail, sq_tail);
+      spinlock_unlock(&sq_lock);
+      return;
+    }
+    spinlock_unlock(&sq_lock);
+
+    /* the ring is full: submit what is there and wait for some of it */
+    flush();
+    reap();
+    yield();
+  }
+}
+
+/* Yield until r is complete, first giving other threads one trip around the
+ * ready list to add their requests to the same batch.
+ */
+static void wait_for(struct aio_req * r) {
+  while(!AO_load_acquire(&r->done)) {
+    yield();
+    if(!submitted(r)) {
+      flush();
+    }
+    reap();
+  }
+}
+
+/* Result of a completed request, like the return value of read */
+static ssize_t result(struct aio_req * r) {
+  if(r->res < 0) {
+    errno = -r->res;
+    return -1;
+  }
+  return r->res;
+}
+
+static size_t iov_total(const struct iovec * iov, int iovcnt) {
+  size_t total = 0;
+  int i;
+  for(i = 0; i < iovcnt; ++i) {
+    total += iov[i].iov_len;
+  }
+  return total;
+}
+
+/* Copy count bytes from src into the buffers of iov */
+static void scatter(const struct iovec * iov, int iovcnt, const char * src, size_t count) {
+  int i;
+  for(i = 0; i < iovcnt && count > 0; ++i) {
+    size_t n = iov[i].iov_len < count ? iov[i].iov_len : count;
+    memcpy(iov[i].iov_base, src, n);
+    src += n;
+    count -= n;
+  }
+}
+
+/* Read from fd into iov at offset, without read-ahead; an offset of -1 reads
+ * from the current file position, as readv does.
+ */
+static ssize_t direct_preadv(int fd, const struct iovec * iov, int iovcnt, off_t offset) {
+  struct aio_req req;
+
+  setup(&req, fd, iov, iovcnt, offset);
+  enqueue(&req);
+  wait_for(&req);
+  return result(&req);
+}
+
+/* Start reading the block at ra->next into ra->buf */
+static void prefetch(struct readahead * ra, int fd) {
+  ra->iov.iov_base = ra->buf;
+  ra->iov.iov_len = ra->block;
+  setup(&ra->req, fd, &ra->iov, 1, ra->next);
+  ra->off = ra->next;
+  ra->len = 0;
+  ra->in_flight = 1;
+  enqueue(&ra->req);
+  flush();
+}
+
+static ssize_t readahead_preadv(struct readahead * ra, int fd,
+                                const struct iovec * iov, int iovcnt, off_t offset) {
+  size_t want = iov_total(iov, iovcnt);
+  size_t got = 0;
+  int at_eof = 0;
+
+  if(ra->in_flight && offset >= ra->off && offset < ra->off + (off_t)ra->block) {
+    wait_for(&ra->req);
+    ra->in_flight = 0;
+    ra->len = result(&ra->req);
+    if(ra->len < 0) {
+      ra->len = 0;
+    }
+  }
+
+  if(!ra->in_flight && offset >= ra->off && offset < ra->off + ra->len) {
+    got = ra->off + ra->len - offset;
+    if(got > want) {
+      got = want;
+    }
+    scatter(iov, iovcnt, ra->buf + (offset - ra->off), got);
+    at_eof = (size_t)ra->len < ra->block;
+  }
+
+  if(got < want && !at_eof) {
+    /* read the rest directly, skipping the part that was already copied */
+    struct iovec rest[iovcnt];
+    size_t skip = got;
+    int i, n = 0;
+
+    for(i = 0; i < iovcnt; ++i) {
+      if(skip >= iov[i].iov_len) {
+        skip -= iov[i].iov_len;
+        continue;
+      }
+      rest[n].iov_base = (char *)iov[i].iov_base + skip;
+      rest[n].iov_len = iov[i].iov_len - skip;
+      skip = 0;
+      ++n;
+    }
+
+    ssize_t r = direct_preadv(fd, rest, n, offset + got);
+    if(r < 0 && got == 0) {
+      return -1;
+    }
+    if(r > 0) {
+      got += r;
+    }
+  }
+
+  int sequential = offset == ra->next;
+  ra->next = offset + got;
+  if(sequential && got > 0 && !ra->in_flight && ra->next >= ra->off + ra->len) {
+    prefetch(ra, fd);
+  }
+  return got;
+}
+
+static ssize_t do_preadv(int fd, const struct iovec * iov, int iovcnt, off_t offset) {
+  struct readahead * ra = NULL;
+
+  if(fd < READAHEAD_MAX_FD) {
+    spinlock_lock(&ra_lock);
+    ra = ra_table[fd];
+    if(ra && AO_test_and_set_acquire(&ra->busy) == AO_TS_SET) {
+      ra = NULL;
+    }
+    spinlock_unlock(&ra_lock);
+  }
+
+  if(ra) {
+    ssize_t r = readahead_preadv(ra, fd, iov, iovcnt, offset);
+    AO_CLEAR(&ra->busy);
+    return r;
+  }
+  return direct_preadv(fd, iov, iovcnt, offset);
+}
+
+ssize_t readv_wrap(int fd, const struct iovec * iov, int iovcnt) {
+  if(iovcnt < 0 || iovcnt > IOV_MAX) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  off_t offset = lseek(fd, 0, SEEK_CUR);
+  if(offset < 0) {
+    return direct_preadv(fd, iov, iovcnt, -1);
+  }
+
+  ssize_t r = do_preadv(fd, iov, iovcnt, offset);
+  if(r > 0) {
+    lseek(fd, offset + r, SEEK_SET);
+  }
+  return r;
+}
+
+ssize_t preadv_wrap(int fd, const struct iovec * iov, int iovcnt, off_t offset) {
+  if(iovcnt < 0 || iovcnt > IOV_MAX || offset < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  /* like preadv, fail with ESPIPE on pipes and sockets */
+  if(lseek(fd, 0, SEEK_CUR) < 0) {
+    return -1;
+  }
+  return do_preadv(fd, iov, iovcnt, offset);
+}
+
+/* Free a read-ahead buffer that is no longer in ra_table, once the thread
+ * using it, if any, is done */
+static void readahead_free(struct readahead * ra) {
+  while(AO_test_and_set_acquire(&ra->busy) == AO_TS_SET) {
+    yield();
+  }
+  if(ra->in_flight) {
+    wait_for(&ra->req);
+  }
+
+  free(ra->buf);
+  free(ra);
+}
+
+int readahead_enable(int fd, size_t block_size) {
+  if(fd < 0 || fd >= READAHEAD_MAX_FD) {
+    errno = EBADF;
+    return -1;
+  }
+
+  struct readahead * ra = malloc(sizeof(struct readahead));
+  char * buf = malloc(block_size);
+  if(!ra || !buf) {
+    free(ra);
+    free(buf);
+    errno = ENOMEM;
+    return -1;
+  }
+
+  ra->busy = AO_TS_INITIALIZER;
+  ra->block = block_size;
+  ra->buf = buf;
+  ra->in_flight = 0;
+  ra->off = 0;
+  ra->len = 0;
+  ra->next = -1;
+
+  spinlock_lock(&ra_lock);
+  struct readahead * replaced = ra_table[fd];
+  ra_table[fd] = ra;
+  spinlock_unlock(&ra_lock);
+
+  if(replaced) {
+    readahead_free(replaced);
+  }
+  return 0;
+}
+
+void readahead_disable(int fd) {
+  if(fd < 0 || fd >= READAHEAD_MAX_FD) {
+    return;
+  }
+
+  spinlock_lock(&ra_lock);
+  struct readahead * ra = ra_table[fd];
+  ra_table[fd] = NULL;
+  spinlock_unlock(&ra_lock);
+
+  if(ra) {
+    readahead_free(ra);
+  }
+}
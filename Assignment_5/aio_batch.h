@@ -0,0 +1,50 @@
+/* CS533 Assignment 5
+ * aio_batch.h: Vectored, batched asynchronous reads with read-ahead
+ *
+ * readv_wrap and preadv_wrap are to readv and preadv what read_wrap is to
+ * read: they block only the calling user-level thread, yielding until the
+ * read is complete. Instead of making one system call per request, every
+ * request goes on an io_uring submission ring, and the ring is handed to the
+ * kernel with a single io_uring_enter call once the requesting threads have
+ * had a chance to run. When many threads are reading at once, that is one
+ * submission per trip around the ready list rather than one per read.
+ *
+ * readahead_enable turns on sequential read-ahead for a file descriptor: once
+ * two reads in a row are found to be sequential, the next block is read in
+ * the background while the thread works on the current one.
+ *
+ * See the "Batched and Vectored Reads" section of README.md.
+ */
+
+#ifndef AIO_BATCH_H
+#define AIO_BATCH_H
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+/* Requests that can be waiting to be submitted at once */
+#define AIO_RING_ENTRIES 256
+
+/* Read-ahead is only available for file descriptors below this */
+#define READAHEAD_MAX_FD 1024
+
+/* Set up the io_uring. Call from scheduler_begin, before creating any kernel
+ * threads. If io_uring is not available, reads block the kernel thread.
+ */
+void aio_batch_init(void);
+
+/* Like read_wrap, readv_wrap reads at the file position and then moves it,
+ * in separate steps, so threads that share an open file description must
+ * not call it at the same time. Use preadv_wrap with offsets of their own.
+ */
+ssize_t readv_wrap(int fd, const struct iovec * iov, int iovcnt);
+ssize_t preadv_wrap(int fd, const struct iovec * iov, int iovcnt, off_t offset);
+
+/* Read block_size bytes ahead of sequential reads on fd, replacing any
+ * read-ahead buffer it already has. Returns 0, or -1 if fd is out of range
+ * or memory runs out. Disable read-ahead before closing fd.
+ */
+int readahead_enable(int fd, size_t block_size);
+void readahead_disable(int fd);
+
+#endif
@@ -0,0 +1,184 @@
+/* CS533 Assignment 5
+ * barrier.c: Barriers for user-level threads and for kernel threads
+ *
+ * barrier_wait parks the same way the mutex in Part 4 does, with the
+ * barrier's spinlock passed to block():
+ *
+ *   waiter                                 last to arrive
+ *     lock b.lock                            lock b.lock  (waiters are
+ *     sense not flipped yet                  count = n     inside block)
+ *     add self to waiters                    flip sense
+ *     state = BLOCKED                        take waiters
+ *     block(&b.lock)                         unlock b.lock
+ *                                            unblock each waiter
+ *
+ * A waiter that takes the lock after the flip sees it and returns instead,
+ * so every waiter on the list is found by the last thread to arrive. Waiter
+ * entries live on the waiting threads' stacks.
+ *
+ * The flip and the taking of the list happen together under the lock, so
+ * episodes cannot mix: a thread that sees the flip while it is still
+ * yielding may go on to the next episode and park there, but only after the
+ * last thread of this one has let go of the lock, when it has taken this
+ * episode's list and the next one starts out empty.
+ *
+ * If the scheduler has unblock_many (see BATCHED_WAKEUPS in README.md), the
+ * last thread hands the waiters over BARRIER_WAKE_BATCH at a time, which
+ * takes the ready list lock once per batch rather than once per waiter.
+ *
+ * Each kbarrier_t participant has its own flags on cache lines of its own,
+ * so spinning on them stays in its own cache until its partner writes.
+ * There are two sets of flags, used on alternate episodes, and the sense the
+ * flags are waited for flips every other episode; that way a fast
+ * participant can never overwrite a flag that a slow one has not read yet.
+ */
+
+#define _GNU_SOURCE
+#include <sched.h>
+#include <stdlib.h>
+
+#include "affinity.h"
+#include "barrier.h"
+#include "scheduler.h"
+
+#define KBARRIER_CACHE_LINE 64
+#define KBARRIER_MAX_ROUNDS 16
+#define BARRIER_WAKE_BATCH  256
+
+struct barrier_waiter {
+  struct thread * t;
+  struct barrier_waiter * next;
+};
+
+struct kbarrier_node {
+  volatile AO_t flags[2][KBARRIER_MAX_ROUNDS];
+  int parity;
+  AO_t sense;
+  char pad[KBARRIER_CACHE_LINE - 2 * sizeof(AO_t)];
+};
+
+struct kbarrier {
+  int n, rounds;
+  size_t size;                   /* of nodes */
+  struct kbarrier_node * nodes;
+};
+
+void barrier_init(barrier_t * b, int n) {
+  b->count = n;
+  b->sense = 0;
+  b->n = n;
+  b->lock = AO_TS_INITIALIZER;
+  b->waiters = NULL;
+}
+
+int barrier_wait(barrier_t * b) {
+  AO_t sense = AO_load_acquire(&b->sense);
+  int i;
+
+  if(AO_fetch_and_sub1_full(&b->count) == 1) {
+    spinlock_lock(&b->lock);
+    AO_store(&b->count, b->n);
+    AO_store_release(&b->sense, !sense);
+    struct barrier_waiter * w = b->waiters;
+    b->waiters = NULL;
+    spinlock_unlock(&b->lock);
+
+    /* a waiter's entry goes away as soon as it runs again */
+#ifdef BATCHED_WAKEUPS
+    while(w) {
+      struct thread * batch[BARRIER_WAKE_BATCH];
+      int n = 0;
+      while(w && n < BARRIER_WAKE_BATCH) {
+        batch[n++] = w->t;
+        w = w->next;
+      }
+      unblock_many(batch, n);
+    }
+#else
+    while(w) {
+      struct barrier_waiter * next = w->next;
+      unblock(w->t);
+      w = next;
+    }
+#endif
+    return BARRIER_SERIAL_THREAD;
+  }
+
+  for(i = 0; i < BARRIER_SPIN_YIELDS; ++i) {
+    if(AO_load_acquire(&b->sense) != sense) {
+      return 0;
+    }
+    yield();
+  }
+
+  struct barrier_waiter me;
+  spinlock_lock(&b->lock);
+  if(AO_load_acquire(&b->sense) != sense) {
+    spinlock_unlock(&b->lock);
+    return 0;
+  }
+  me.t = current_thread;
+  me.next = b->waiters;
+  b->waiters = &me;
+  current_thread->state = BLOCKED;
+  block(&b->lock);
+  return 0;
+}
+
+kbarrier_t * kbarrier_create(int n) {
+  kbarrier_t * b = malloc(sizeof(kbarrier_t));
+  int i;
+
+  b->n = n;
+  for(b->rounds = 0; (1 << b->rounds) < n; ++b->rounds) {
+  }
+  if(b->rounds > KBARRIER_MAX_ROUNDS) {
+    free(b);
+    return NULL;
+  }
+
+  /* fresh zeroed pages, so every flag starts out clear */
+  b->size = sizeof(struct kbarrier_node) * n;
+  b->nodes = node_alloc(b->size);
+  if(!b->nodes) {
+    free(b);
+    return NULL;
+  }
+  for(i = 0; i < n; ++i) {
+    b->nodes[i].parity = 0;
+    b->nodes[i].sense = 1;
+  }
+  return b;
+}
+
+void kbarrier_destroy(kbarrier_t * b) {
+  node_free(b->nodes, b->size);
+  free(b);
+}
+
+static void spin_until(volatile AO_t * flag, AO_t value) {
+  int spins = 0;
+  while(AO_load_acquire(flag) != value) {
+    if(++spins == KBARRIER_SPINS) {
+      sched_yield();
+      spins = 0;
+    }
+  }
+}
+
+void kbarrier_wait(kbarrier_t * b, int id) {
+  struct kbarrier_node * me = &b->nodes[id];
+  int parity = me->parity, k, distance;
+  AO_t sense = me->sense;
+
+  for(k = 0, distance = 1; k < b->rounds; ++k, distance <<= 1) {
+    struct kbarrier_node * partner = &b->nodes[(id + distance) % b->n];
+    AO_store_release(&partner->flags[parity][k], sense);
+    spin_until(&me->flags[parity][k], sense);
+  }
+
+  if(parity == 1) {
+    me->sense = !sense;
+  }
+  me->parity = 1 - parity;
+}
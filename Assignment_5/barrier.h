@@ -0,0 +1,57 @@
+/* CS533 Assignment 5
+ * barrier.h: Barriers for user-level threads and for kernel threads
+ *
+ * barrier_t is for user-level threads. It is a sense-reversing barrier: the
+ * last thread to arrive flips the barrier's sense, which is what the others
+ * are waiting to see. A waiting thread yields a few times in case the rest
+ * are about to arrive, and then parks with block() until the last one
+ * unblocks it, so it never keeps a kernel thread busy.
+ *
+ * kbarrier_t is for kernel threads that are not running the scheduler, such
+ * as the ones spinlock_test.c clones. It is a dissemination barrier: in
+ * round k, participant i signals participant i + 2^k and waits for the
+ * signal from participant i - 2^k, so after log2(n) rounds every participant
+ * has heard from every other, and no flag is ever written by more than one
+ * of them.
+ *
+ * See the "Barriers" section of README.md.
+ */
+
+#ifndef BARRIER_H
+#define BARRIER_H
+
+#include <atomic_ops.h>
+
+/* barrier_wait returns this to exactly one of the threads in each episode,
+ * and 0 to the others */
+#define BARRIER_SERIAL_THREAD 1
+
+/* Yields before a thread waiting at a barrier_t parks */
+#define BARRIER_SPIN_YIELDS 8
+
+/* Spins before a kernel thread waiting at a kbarrier_t calls sched_yield */
+#define KBARRIER_SPINS 1000
+
+struct barrier_waiter;
+
+typedef struct barrier {
+  volatile AO_t count;           /* threads still to arrive */
+  volatile AO_t sense;
+  int n;
+  AO_TS_t lock;                  /* protects waiters */
+  struct barrier_waiter * waiters;
+} barrier_t;
+
+void barrier_init(barrier_t * b, int n);
+int barrier_wait(barrier_t * b);
+
+typedef struct kbarrier kbarrier_t;
+
+kbarrier_t * kbarrier_create(int n);
+void kbarrier_destroy(kbarrier_t * b);
+
+/* id is the caller's participant number, from 0 to n - 1; every participant
+ * must use the same one every time */
+void kbarrier_wait(kbarrier_t * b, int id);
+
+#endif
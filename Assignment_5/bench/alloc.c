@@ -0,0 +1,118 @@
+/* CS533 Assignment 5
+ * alloc.c: Allocator benchmarks
+ *
+ * Each sample is one fork/join region: four counter threads per kernel
+ * thread share ops records between them. Every record is allocated, given
+ * the next count and put on its thread's list; after the join, the forking
+ * thread adds up the counts and frees every record, so almost every free is
+ * of memory allocated on another kernel thread. Record sizes vary from 16 to
+ * 256 bytes. Returns nanoseconds per record, allocation and free included.
+ *
+ *   counter_malloc   malloc and free, i.e. safe_mem
+ *   counter_talloc   thread_alloc and thread_free
+ *   counter_arena    arena_alloc, and one arena_destroy for the whole region
+ */
+
+#include <stdlib.h>
+
+#include "bench.h"
+#include "thread_alloc.h"
+#include "scheduler.h"
+
+#define COUNTERS_PER_KTHREAD 4
+#define YIELD_EVERY          64
+
+typedef enum { USE_MALLOC, USE_THREAD_ALLOC, USE_ARENA } allocator_t;
+
+struct record {
+  struct record * next;
+  long count;
+};
+
+struct counter {
+  long records;
+  struct record * list;
+};
+
+static allocator_t allocator;
+static arena_t * arena;
+
+static void * alloc_record(long i) {
+  size_t size = sizeof(struct record) + (i * 37) % 241;
+
+  switch(allocator) {
+    case USE_MALLOC:       return malloc(size);
+    case USE_THREAD_ALLOC: return thread_alloc(size);
+    default:               return arena_alloc(arena, size);
+  }
+}
+
+static void counter(void * arg) {
+  struct counter * c = arg;
+  long i;
+
+  for(i = 0; i < c->records; ++i) {
+    struct record * r = alloc_record(i);
+    r->count = i + 1;
+    r->next = c->list;
+    c->list = r;
+    if(i % YIELD_EVERY == YIELD_EVERY - 1) {
+      yield();
+    }
+  }
+}
+
+static double region(int num_kthreads, long ops, allocator_t which) {
+  int n = num_kthreads * COUNTERS_PER_KTHREAD, i;
+  struct counter counters[n];
+  struct thread * threads[n];
+  long expected = 0, total = 0;
+
+  allocator = which;
+  double start = now_ns();
+  if(which == USE_ARENA) {
+    arena = arena_create();
+  }
+
+  for(i = 0; i < n; ++i) {
+    counters[i].records = ops * (i + 1) / n - ops * i / n;
+    counters[i].list = NULL;
+    expected += counters[i].records * (counters[i].records + 1) / 2;
+    threads[i] = thread_fork(counter, &counters[i]);
+  }
+  for(i = 0; i < n; ++i) {
+    thread_join(threads[i]);
+  }
+
+  for(i = 0; i < n; ++i) {
+    struct record * r = counters[i].list;
+    while(r) {
+      struct record * next = r->next;
+      total += r->count;
+      if(which == USE_MALLOC) {
+        free(r);
+      } else if(which == USE_THREAD_ALLOC) {
+        thread_free(r);
+      }
+      r = next;
+    }
+  }
+  if(which == USE_ARENA) {
+    arena_destroy(arena);
+  }
+  double elapsed = now_ns() - start;
+
+  return total == expected ? elapsed / ops : -1;
+}
+
+double bench_counter_malloc(int num_kthreads, long ops) {
+  return region(num_kthreads, ops, USE_MALLOC);
+}
+
+double bench_counter_talloc(int num_kthreads, long ops) {
+  return region(num_kthreads, ops, USE_THREAD_ALLOC);
+}
+
+double bench_counter_arena(int num_kthreads, long ops) {
+  return region(num_kthreads, ops, USE_ARENA);
+}
@@ -0,0 +1,114 @@
+/* CS533 Assignment 5
+ * barrier.c: Barrier latency benchmarks
+ *
+ * Every participant goes through ops barrier episodes back to back, with no
+ * work in between, so each sample is the time one episode takes from the
+ * first arrival to the last departure. Returns nanoseconds per episode.
+ *
+ *   barrier_2, barrier_8, barrier_64   that many user-level threads at a
+ *                                      barrier_t
+ *   kbarrier                           one kernel thread per kernel thread
+ *                                      count (at least two) at a kbarrier_t;
+ *                                      the benchmark thread is participant 0
+ *                                      and the rest are cloned for the sample
+ */
+
+#define _GNU_SOURCE
+#include <sched.h>
+#include <stdlib.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "affinity.h"
+#include "barrier.h"
+#include "bench.h"
+#include "scheduler.h"
+
+#define KBARRIER_STACK_SIZE (64 * 1024)
+
+static barrier_t barrier;
+static kbarrier_t * kbarrier;
+static long episodes;
+
+static void participant(void * arg) {
+  long i;
+  for(i = 0; i < episodes; ++i) {
+    barrier_wait(&barrier);
+  }
+}
+
+static double green(int n, long ops) {
+  struct thread * threads[n];
+  int i;
+
+  barrier_init(&barrier, n);
+  episodes = ops;
+
+  double start = now_ns();
+  for(i = 0; i < n; ++i) {
+    threads[i] = thread_fork(participant, NULL);
+  }
+  for(i = 0; i < n; ++i) {
+    thread_join(threads[i]);
+  }
+  return (now_ns() - start) / ops;
+}
+
+double bench_barrier_2(int num_kthreads, long ops) {
+  return green(2, ops);
+}
+
+double bench_barrier_8(int num_kthreads, long ops) {
+  return green(8, ops);
+}
+
+double bench_barrier_64(int num_kthreads, long ops) {
+  return green(64, ops);
+}
+
+/* A cloned participant. It must not touch anything thread-local, since it
+ * shares the benchmark kernel thread's TLS.
+ */
+static int kparticipant(void * arg) {
+  int id = (int)(long)arg;
+  long i;
+  for(i = 0; i < episodes; ++i) {
+    kbarrier_wait(kbarrier, id);
+  }
+  return 0;
+}
+
+double bench_kbarrier(int num_kthreads, long ops) {
+  int n = num_kthreads < 2 ? 2 : num_kthreads, i;
+  volatile pid_t tids[n];
+  char * stacks = node_alloc(KBARRIER_STACK_SIZE * n);
+
+  kbarrier = kbarrier_create(n);
+  episodes = ops;
+
+  double start = now_ns();
+  for(i = 1; i < n; ++i) {
+    tids[i] = 1;
+    if(clone(kparticipant, stacks + KBARRIER_STACK_SIZE * (i + 1),
+             CLONE_THREAD | CLONE_VM | CLONE_SIGHAND | CLONE_FILES | CLONE_FS |
+             CLONE_CHILD_CLEARTID, (void *)(long)i, NULL, NULL, &tids[i]) < 0) {
+      /* the others would wait for it forever */
+      abort();
+    }
+  }
+  kparticipant((void *)0);
+  double elapsed = now_ns() - start;
+
+  /* the kernel clears tids[i] once participant i has exited */
+  for(i = 1; i < n; ++i) {
+    pid_t tid;
+    while((tid = tids[i]) != 0) {
+      syscall(SYS_futex, &tids[i], FUTEX_WAIT, tid, NULL, NULL, 0);
+    }
+  }
+
+  kbarrier_destroy(kbarrier);
+  node_free(stacks, KBARRIER_STACK_SIZE * n);
+  return elapsed / ops;
+}
@@ -0,0 +1,422 @@
+/* CS533 Assignment 5
+ * bench.c: Benchmark driver
+ *
+ * usage: benchmark [-f csv|json] [-k max_kthreads] [-r reps] [-s scale]
+ *                  [-b name,name,...] [-d distribution] [-t | -l]
+ *
+ * Runs each selected benchmark with 1, 2, 4, ... up to max_kthreads kernel
+ * threads. Every (benchmark, kthreads) pair runs in its own child process,
+ * which calls scheduler_begin, takes one warm-up sample followed by reps
+ * measured samples, and sends them back over a pipe. The parent reports the
+ * min, median, 90th/99th percentiles, max and mean of the samples.
+ *
+ * A negative sample means the benchmark detected a wrong result (e.g. an
+ * unsorted array); that configuration is reported on stderr and skipped.
+ *
+ * -d picks the input distribution of the sort benchmarks (see datagen.h);
+ * the default is random.
+ *
+ * With -t, the child also counts the dTLB misses of every sample with
+ * perf_event_open, in user space only, and the parent reports them as a
+ * second row with the unit "dTLB". The counters are opened before
+ * scheduler_begin with inherit set, so they include every kernel thread.
+ * -l does the same for L2 misses, with the unit "L2miss". perf has no
+ * generic event for those, so it counts accesses to the last-level cache,
+ * which on a CPU with three levels of cache are the L2 misses. Only one of
+ * -t and -l may be given.
+ *
+ * Built with -DUNIPROCESSOR (benchmark_up), every benchmark runs with one
+ * kernel thread whatever -k says, and kbarrier, which needs several, is left
+ * out.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <stdint.h>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "bench.h"
+#include "scheduler.h"
+
+dist_t sort_dist = DIST_RANDOM;
+unsigned long sort_seed;
+
+static struct benchmark benchmarks[] = {
+  { "yield",     "ns/op", 100000,  bench_yield },
+  { "fork_join", "ns/op", 1000,    bench_fork_join },
+  { "fork_exit", "thr/s", 20000,   bench_fork_exit },
+  { "mutex",     "ns/op", 20000,   bench_mutex },
+  { "condition", "ns/op", 20000,   bench_condition },
+  { "read_wrap", "ns/op", 2000,    bench_read_wrap },
+  { "spinlock",  "ns/op", 100000,  bench_spinlock },
+  { "chan_1_1",  "msg/s", 100000,  bench_chan_1_1 },
+  { "chan_n_1",  "msg/s", 100000,  bench_chan_n_1 },
+  { "chan_n_m",  "msg/s", 100000,  bench_chan_n_m },
+  { "scan_1",     "MB/s", 1024,    bench_scan_1 },
+  { "scan_64",    "MB/s", 1024,    bench_scan_64 },
+  { "scan_ra_1",  "MB/s", 1024,    bench_scan_ra_1 },
+  { "scan_ra_64", "MB/s", 1024,    bench_scan_ra_64 },
+  { "barrier_2",  "ns/op", 10000,   bench_barrier_2 },
+  { "barrier_8",  "ns/op", 10000,   bench_barrier_8 },
+  { "barrier_64", "ns/op", 10000,   bench_barrier_64 },
+#ifndef UNIPROCESSOR
+  { "kbarrier",   "ns/op", 10000,   bench_kbarrier },
+#endif
+  { "counter_malloc", "ns/op", 100000, bench_counter_malloc },
+  { "counter_talloc", "ns/op", 100000, bench_counter_talloc },
+  { "counter_arena",  "ns/op", 100000, bench_counter_arena },
+  { "fan_out",      "us", 10000, bench_fan_out },
+#ifdef BATCHED_WAKEUPS
+  { "fan_out_many", "us", 10000, bench_fan_out_many },
+#endif
+  { "broadcast",    "us", 10000, bench_broadcast },
+#ifdef THREAD_KEYS
+  { "getspecific",         "ns/op", 1000000, bench_getspecific },
+#endif
+  { "pthread_getspecific", "ns/op", 1000000, bench_pthread_getspecific },
+  { "map_chained",    "op/s", 1000000, bench_map_chained },
+  { "map_cmap",       "op/s", 1000000, bench_map_cmap },
+  { "map_cmap_put",   "op/s", 100000,  bench_map_cmap_put },
+  { "map_cmap_churn", "op/s", 100000,  bench_map_cmap_churn },
+#ifdef AFFINE_WAKEUPS
+  { "wake_affine",    "ns/op", 20000, bench_wake_affine },
+  { "wake_shared",    "ns/op", 20000, bench_wake_shared },
+  { "migrate_affine", "mig/s", 20000, bench_migrate_affine },
+  { "migrate_shared", "mig/s", 20000, bench_migrate_shared },
+#endif
+  { "serve_copy",         "MB/s",  256, bench_serve_copy },
+  { "serve_sendfile",     "MB/s",  256, bench_serve_sendfile },
+  { "serve_splice",       "MB/s",  256, bench_serve_splice },
+  { "serve_copy_cpu",     "ms/GB", 256, bench_serve_copy_cpu },
+  { "serve_sendfile_cpu", "ms/GB", 256, bench_serve_sendfile_cpu },
+  { "serve_splice_cpu",   "ms/GB", 256, bench_serve_splice_cpu },
+#if defined(SCHEDULER_INSTANCES) && !defined(UNIPROCESSOR)
+  { "pairs_shared",  "ns/op", 20000, bench_pairs_shared },
+  { "pairs_sharded", "ns/op", 20000, bench_pairs_sharded },
+  { "local_wake",    "ns/op", 20000, bench_local_wake },
+  { "cross_wake",    "ns/op", 20000, bench_cross_wake },
+#endif
+  { "sort",        "ms",  1000000, bench_sort, "none", "none" },
+  { "sort_pinned", "ms",  1000000, bench_sort, "compact", "none" },
+  { "sort_thp",     "ms", 1000000, bench_sort, "none", "thp" },
+  { "sort_hugetlb", "ms", 1000000, bench_sort, "none", "hugetlb" },
+  { "sort_talloc",  "ms", 1000000, bench_sort_talloc, "none", "none" },
+  { "primes",       "ms", 100000000, bench_primes },
+  { "nth_prime",    "ms", 5000000, bench_nth_prime },
+  { "mixed",        "ms", 2000,    bench_mixed },
+  { "mixed_region", "ms", 2000,    bench_mixed_region },
+};
+
+#define NUM_BENCHMARKS (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+typedef enum { CSV, JSON } format_t;
+
+struct stats {
+  double min, median, p90, p99, max, mean;
+};
+
+static int compare_doubles(const void * a, const void * b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+/* nearest-rank percentile of a sorted sample */
+static double percentile(double * sorted, int n, double p) {
+  int rank = (int)ceil(p / 100.0 * n);
+  return sorted[rank < 1 ? 0 : rank - 1];
+}
+
+static void compute_stats(double * samples, int n, struct stats * s) {
+  int i;
+  double sum = 0;
+
+  qsort(samples, n, sizeof(double), compare_doubles);
+  for(i = 0; i < n; ++i) {
+    sum += samples[i];
+  }
+
+  s->min    = samples[0];
+  s->median = n % 2 ? samples[n/2] : (samples[n/2 - 1] + samples[n/2]) / 2;
+  s->p90    = percentile(samples, n, 90);
+  s->p99    = percentile(samples, n, 99);
+  s->max    = samples[n-1];
+  s->mean   = sum / n;
+}
+
+/* What -t and -l count: loads and stores with a given result in a cache */
+struct miss_counter {
+  const char * unit;
+  int cache;                     /* PERF_COUNT_HW_CACHE_... */
+  int result;                    /* PERF_COUNT_HW_CACHE_RESULT_... */
+};
+
+static const struct miss_counter tlb_misses =
+  { "dTLB", PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_RESULT_MISS };
+static const struct miss_counter l2_misses =
+  { "L2miss", PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_RESULT_ACCESS };
+
+/* Load and store counters; not every CPU counts stores */
+static int counter_fds[2] = { -1, -1 };
+
+static void counter_open(const struct miss_counter * counter) {
+  struct perf_event_attr attr;
+  int i;
+
+  for(i = 0; i < 2; ++i) {
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = counter->cache |
+                  (i ? PERF_COUNT_HW_CACHE_OP_WRITE : PERF_COUNT_HW_CACHE_OP_READ) << 8 |
+                  counter->result << 16;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    counter_fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+  }
+}
+
+/* Misses so far, or -1 if there is no counter */
+static double counter_read(void) {
+  double total = -1;
+  uint64_t count;
+  int i;
+
+  for(i = 0; i < 2; ++i) {
+    if(counter_fds[i] >= 0 && read(counter_fds[i], &count, sizeof(count)) == sizeof(count)) {
+      total = (total < 0 ? 0 : total) + count;
+    }
+  }
+  return total;
+}
+
+/* Run one benchmark on num_kthreads kernel threads in a child process.
+ * Returns the number of samples read back into samples, and with a counter,
+ * the misses of each sample in misses.
+ */
+static int run_config(struct benchmark * b, int num_kthreads, long ops,
+                      int reps, double * samples, const struct miss_counter * counter,
+                      double * misses) {
+  int fds[2];
+  if(pipe(fds) < 0) {
+    perror("pipe");
+    return 0;
+  }
+
+  fflush(stdout);
+  pid_t pid = fork();
+  if(pid < 0) {
+    perror("fork");
+    return 0;
+  }
+
+  if(pid == 0) {
+    close(fds[0]);
+    if(b->placement) {
+      setenv("KTHREAD_PLACEMENT", b->placement, 1);
+    }
+    if(b->hugepages) {
+      setenv("KTHREAD_HUGEPAGES", b->hugepages, 1);
+    }
+    if(counter) {
+      counter_open(counter);
+    }
+    scheduler_begin(num_kthreads);
+
+    b->run(num_kthreads, ops);
+    sort_seed = 0;
+    int i;
+    for(i = 0; i < reps; ++i) {
+      double before = counter ? counter_read() : 0;
+      double sample[2] = { b->run(num_kthreads, ops), 0 };
+      if(counter) {
+        sample[1] = before < 0 ? -1 : counter_read() - before;
+      }
+      write(fds[1], sample, sizeof(double) * (counter ? 2 : 1));
+    }
+
+    /* _exit takes the other kernel threads down with it */
+    _exit(0);
+  }
+
+  close(fds[1]);
+  int n = 0;
+  double sample[2];
+  size_t size = sizeof(double) * (counter ? 2 : 1);
+  while(n < reps && read(fds[0], sample, size) == (ssize_t)size) {
+    samples[n] = sample[0];
+    if(counter) {
+      misses[n] = sample[1];
+    }
+    ++n;
+  }
+  close(fds[0]);
+  waitpid(pid, NULL, 0);
+  return n;
+}
+
+static void print_header(format_t format) {
+  if(format == CSV) {
+    printf("benchmark,kthreads,unit,samples,min,median,p90,p99,max,mean\n");
+  } else {
+    printf("[");
+  }
+}
+
+static void print_row(format_t format, int first, const char * name,
+                      const char * unit, int num_kthreads, int n, struct stats * s) {
+  if(format == CSV) {
+    printf("%s,%d,%s,%d,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f\n",
+           name, num_kthreads, unit, n,
+           s->min, s->median, s->p90, s->p99, s->max, s->mean);
+  } else {
+    printf("%s\n  {\"benchmark\": \"%s\", \"kthreads\": %d, \"unit\": \"%s\", "
+           "\"samples\": %d, \"min\": %.3f, \"median\": %.3f, \"p90\": %.3f, "
+           "\"p99\": %.3f, \"max\": %.3f, \"mean\": %.3f}",
+           first ? "" : ",", name, num_kthreads, unit, n,
+           s->min, s->median, s->p90, s->p99, s->max, s->mean);
+  }
+  fflush(stdout);
+}
+
+static void print_footer(format_t format) {
+  if(format == JSON) {
+    printf("\n]\n");
+  }
+}
+
+static int selected(const char * list, const char * name) {
+  if(!list) {
+    return 1;
+  }
+
+  size_t len = strlen(name);
+  const char * p = list;
+  while((p = strstr(p, name))) {
+    if((p == list || p[-1] == ',') && (p[len] == ',' || p[len] == '\0')) {
+      return 1;
+    }
+    p += len;
+  }
+  return 0;
+}
+
+static void usage(const char * prog) {
+  fprintf(stderr, "usage: %s [-f csv|json] [-k max_kthreads] [-r reps] "
+                  "[-s scale] [-b name,name,...] [-d distribution] [-t | -l]\n", prog);
+  exit(1);
+}
+
+int main(int argc, char ** argv) {
+  format_t format = CSV;
+  int max_kthreads = sysconf(_SC_NPROCESSORS_ONLN);
+  int reps = 10;
+  double scale = 1.0;
+  const char * only = NULL;
+  const struct miss_counter * counter = NULL;
+
+  int opt;
+  while((opt = getopt(argc, argv, "f:k:r:s:b:d:tl")) != -1) {
+    switch(opt) {
+      case 'f':
+        if(!strcmp(optarg, "csv")) {
+          format = CSV;
+        } else if(!strcmp(optarg, "json")) {
+          format = JSON;
+        } else {
+          usage(argv[0]);
+        }
+        break;
+      case 'k': max_kthreads = atoi(optarg); break;
+      case 'r': reps = atoi(optarg);         break;
+      case 's': scale = atof(optarg);        break;
+      case 'b': only = optarg;               break;
+      case 'd':
+        if(dist_parse(optarg) < 0) {
+          usage(argv[0]);
+        }
+        sort_dist = dist_parse(optarg);
+        break;
+      case 't':
+      case 'l': {
+        /* each sample has room for one count */
+        const struct miss_counter * c = opt == 't' ? &tlb_misses : &l2_misses;
+        if(counter && counter != c) {
+          usage(argv[0]);
+        }
+        counter = c;
+        break;
+      }
+      default:  usage(argv[0]);
+    }
+  }
+  if(max_kthreads < 1 || reps < 1 || scale <= 0) {
+    usage(argv[0]);
+  }
+#ifdef UNIPROCESSOR
+  max_kthreads = 1;
+#endif
+
+  double * samples = malloc(sizeof(double) * reps);
+  double * misses = malloc(sizeof(double) * reps);
+  int first = 1;
+  unsigned i;
+
+  print_header(format);
+  for(i = 0; i < NUM_BENCHMARKS; ++i) {
+    struct benchmark * b = &benchmarks[i];
+    if(!selected(only, b->name)) {
+      continue;
+    }
+
+    long ops = b->ops * scale;
+    if(ops < 1) {
+      ops = 1;
+    }
+
+    int k = 1;
+    while(1) {
+      int n = run_config(b, k, ops, reps, samples, counter, misses);
+      struct stats s;
+
+      if(n < reps) {
+        fprintf(stderr, "%s: child exited after %d of %d samples "
+                        "with %d kthreads\n", b->name, n, reps, k);
+      } else {
+        compute_stats(samples, n, &s);
+        if(s.min < 0) {
+          fprintf(stderr, "%s: wrong result with %d kthreads\n", b->name, k);
+        } else {
+          print_row(format, first, b->name, b->unit, k, n, &s);
+          first = 0;
+
+          if(counter) {
+            compute_stats(misses, n, &s);
+            if(s.min < 0) {
+              fprintf(stderr, "%s: no %s counters with %d kthreads\n",
+                      b->name, counter->unit, k);
+            } else {
+              print_row(format, first, b->name, counter->unit, k, n, &s);
+            }
+          }
+        }
+      }
+
+      if(k == max_kthreads) {
+        break;
+      }
+      k = k * 2 > max_kthreads ? max_kthreads : k * 2;
+    }
+  }
+  print_footer(format);
+
+  free(samples);
+  free(misses);
+  return 0;
+}
@@ -0,0 +1,122 @@
+/* CS533 Assignment 5
+ * bench.h: Benchmark suite for the threading runtime
+ *
+ * Each benchmark measures one operation of the scheduler API. The driver in
+ * bench.c runs every benchmark in a fresh process for each kernel thread
+ * count, so that scheduler_begin() is only ever called once per process.
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <time.h>
+
+#include "datagen.h"
+
+/* A benchmark's run function is called from a user-level thread after
+ * scheduler_begin(num_kthreads). It performs ops operations and returns one
+ * sample, measured in the benchmark's unit.
+ *
+ * If placement is set, KTHREAD_PLACEMENT is set to it before
+ * scheduler_begin (see affinity.h), and likewise hugepages and
+ * KTHREAD_HUGEPAGES (see hugepage.h).
+ */
+struct benchmark {
+  const char * name;
+  const char * unit;
+  long ops;
+  double (*run)(int num_kthreads, long ops);
+  const char * placement;
+  const char * hugepages;
+};
+
+/* Monotonic wall clock, in nanoseconds */
+static inline double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* bench.c: input distribution of the sort benchmarks, from -d, and the seed
+ * of the last array they sorted, which is reset to 0 after the warm-up
+ */
+extern dist_t sort_dist;
+extern unsigned long sort_seed;
+
+/* micro.c */
+double bench_yield(int num_kthreads, long ops);
+double bench_fork_join(int num_kthreads, long ops);
+double bench_fork_exit(int num_kthreads, long ops);
+double bench_mutex(int num_kthreads, long ops);
+double bench_condition(int num_kthreads, long ops);
+double bench_read_wrap(int num_kthreads, long ops);
+double bench_spinlock(int num_kthreads, long ops);
+
+/* channels.c */
+double bench_chan_1_1(int num_kthreads, long ops);
+double bench_chan_n_1(int num_kthreads, long ops);
+double bench_chan_n_m(int num_kthreads, long ops);
+
+/* io.c */
+double bench_scan_1(int num_kthreads, long ops);
+double bench_scan_64(int num_kthreads, long ops);
+double bench_scan_ra_1(int num_kthreads, long ops);
+double bench_scan_ra_64(int num_kthreads, long ops);
+
+/* barrier.c */
+double bench_barrier_2(int num_kthreads, long ops);
+double bench_barrier_8(int num_kthreads, long ops);
+double bench_barrier_64(int num_kthreads, long ops);
+double bench_kbarrier(int num_kthreads, long ops);
+
+/* alloc.c */
+double bench_counter_malloc(int num_kthreads, long ops);
+double bench_counter_talloc(int num_kthreads, long ops);
+double bench_counter_arena(int num_kthreads, long ops);
+
+/* fanout.c; fan_out_many only if scheduler.h defines BATCHED_WAKEUPS */
+double bench_fan_out(int num_kthreads, long ops);
+double bench_fan_out_many(int num_kthreads, long ops);
+double bench_broadcast(int num_kthreads, long ops);
+
+/* primes.c */
+double bench_primes(int num_kthreads, long ops);
+double bench_nth_prime(int num_kthreads, long ops);
+
+/* keys.c; getspecific only if scheduler.h defines THREAD_KEYS */
+double bench_getspecific(int num_kthreads, long ops);
+double bench_pthread_getspecific(int num_kthreads, long ops);
+
+/* map.c */
+double bench_map_chained(int num_kthreads, long ops);
+double bench_map_cmap(int num_kthreads, long ops);
+double bench_map_cmap_put(int num_kthreads, long ops);
+double bench_map_cmap_churn(int num_kthreads, long ops);
+
+/* wake.c, only if scheduler.h defines AFFINE_WAKEUPS */
+double bench_wake_affine(int num_kthreads, long ops);
+double bench_wake_shared(int num_kthreads, long ops);
+double bench_migrate_affine(int num_kthreads, long ops);
+double bench_migrate_shared(int num_kthreads, long ops);
+
+/* serve.c */
+double bench_serve_copy(int num_kthreads, long ops);
+double bench_serve_sendfile(int num_kthreads, long ops);
+double bench_serve_splice(int num_kthreads, long ops);
+double bench_serve_copy_cpu(int num_kthreads, long ops);
+double bench_serve_sendfile_cpu(int num_kthreads, long ops);
+double bench_serve_splice_cpu(int num_kthreads, long ops);
+
+/* shard.c, only if scheduler.h defines SCHEDULER_INSTANCES */
+double bench_pairs_shared(int num_kthreads, long ops);
+double bench_pairs_sharded(int num_kthreads, long ops);
+double bench_local_wake(int num_kthreads, long ops);
+double bench_cross_wake(int num_kthreads, long ops);
+
+/* macro.c */
+double bench_sort(int num_kthreads, long ops);
+double bench_sort_talloc(int num_kthreads, long ops);
+double bench_mixed(int num_kthreads, long ops);
+double bench_mixed_region(int num_kthreads, long ops);
+
+#endif
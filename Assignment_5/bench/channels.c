@@ -0,0 +1,108 @@
+/* CS533 Assignment 5
+ * channels.c: Channel throughput benchmarks
+ *
+ * Producers send ops messages each, in batches, to consumers over one
+ * channel. Every function here returns the number of messages delivered per
+ * second.
+ */
+
+#include <stdlib.h>
+
+#include "bench.h"
+#include "channel.h"
+#include "scheduler.h"
+
+#define CHAN_CAPACITY 1024
+#define CHAN_BATCH    16
+
+/* a message that tells a consumer to stop; real messages are never NULL */
+#define STOP NULL
+
+static channel_t * bench_chan;
+static long chan_ops;
+static AO_t chan_received;
+
+static void producer(void * arg) {
+  void * batch[CHAN_BATCH];
+  long i;
+  int j;
+
+  for(j = 0; j < CHAN_BATCH; ++j) {
+    batch[j] = (void*)1;
+  }
+  for(i = 0; i < chan_ops; i += CHAN_BATCH) {
+    int n = chan_ops - i < CHAN_BATCH ? chan_ops - i : CHAN_BATCH;
+    chan_send_many(bench_chan, batch, n);
+  }
+}
+
+static void consumer(void * arg) {
+  void * batch[CHAN_BATCH];
+  long received = 0;
+  int stops = 0;
+
+  while(!stops) {
+    int n = chan_recv_many(bench_chan, batch, CHAN_BATCH), j;
+    for(j = 0; j < n; ++j) {
+      if(batch[j] == STOP) {
+        ++stops;
+      } else {
+        ++received;
+      }
+    }
+  }
+
+  /* give back the stop messages meant for the other consumers */
+  while(--stops > 0) {
+    chan_send(bench_chan, STOP);
+  }
+  AO_fetch_and_add_full(&chan_received, received);
+}
+
+static double run_topology(int producers, int consumers, long ops) {
+  struct thread ** threads = malloc(sizeof(struct thread *) * (producers + consumers));
+  int i;
+
+  bench_chan = chan_create(CHAN_CAPACITY);
+  chan_ops = ops;
+  chan_received = 0;
+
+  double start = now_ns();
+  for(i = 0; i < consumers; ++i) {
+    threads[i] = thread_fork(consumer, NULL);
+  }
+  for(i = 0; i < producers; ++i) {
+    threads[consumers + i] = thread_fork(producer, NULL);
+  }
+
+  for(i = 0; i < producers; ++i) {
+    thread_join(threads[consumers + i]);
+  }
+  for(i = 0; i < consumers; ++i) {
+    chan_send(bench_chan, STOP);
+  }
+  for(i = 0; i < consumers; ++i) {
+    thread_join(threads[i]);
+  }
+  double elapsed = now_ns() - start;
+
+  chan_destroy(bench_chan);
+  free(threads);
+
+  if(AO_load(&chan_received) != (AO_t)producers * ops) {
+    return -1;
+  }
+  return producers * ops / (elapsed / 1e9);
+}
+
+double bench_chan_1_1(int num_kthreads, long ops) {
+  return run_topology(1, 1, ops);
+}
+
+double bench_chan_n_1(int num_kthreads, long ops) {
+  return run_topology(num_kthreads, 1, ops);
+}
+
+double bench_chan_n_m(int num_kthreads, long ops) {
+  return run_topology(num_kthreads, num_kthreads, ops);
+}
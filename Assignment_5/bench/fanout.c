@@ -0,0 +1,112 @@
+/* CS533 Assignment 5
+ * fanout.c: Starting and waking many threads at once
+ *
+ * ops is the number of threads, and every benchmark returns microseconds
+ * for all of them:
+ *
+ *   fan_out        fork ops tasks one thread_fork at a time, then join them
+ *   fan_out_many   the same with one thread_fork_many; only if scheduler.h
+ *                  defines BATCHED_WAKEUPS
+ *   broadcast      one condition_broadcast to ops parked threads, timed from
+ *                  the call until it returns
+ *
+ * Every task adds one to a counter, and the fan-outs return -1 if the count
+ * comes out wrong.
+ */
+
+#include <stdlib.h>
+
+#include "bench.h"
+#include "scheduler.h"
+
+static volatile AO_t done;
+
+static void task(void * arg) {
+  AO_fetch_and_add1_full(&done);
+}
+
+static double join_all(struct thread ** threads, long n, double start) {
+  long i;
+  for(i = 0; i < n; ++i) {
+    thread_join(threads[i]);
+  }
+  double elapsed = now_ns() - start;
+
+  free(threads);
+  return AO_load(&done) == (AO_t)n ? elapsed / 1e3 : -1;
+}
+
+double bench_fan_out(int num_kthreads, long ops) {
+  struct thread ** threads = malloc(sizeof(struct thread *) * ops);
+  long i;
+
+  AO_store(&done, 0);
+  double start = now_ns();
+  for(i = 0; i < ops; ++i) {
+    threads[i] = thread_fork(task, NULL);
+  }
+  return join_all(threads, ops, start);
+}
+
+#ifdef BATCHED_WAKEUPS
+double bench_fan_out_many(int num_kthreads, long ops) {
+  struct thread ** threads = malloc(sizeof(struct thread *) * ops);
+
+  AO_store(&done, 0);
+  double start = now_ns();
+  thread_fork_many(task, NULL, ops, threads);
+  return join_all(threads, ops, start);
+}
+#endif
+
+
+/* The waiters count themselves under the mutex before they wait, so once the
+ * count is complete and the broadcaster holds the mutex, all of them are on
+ * the condition's queue.
+ */
+
+static struct mutex herd_mutex;
+static struct condition herd;
+static long parked;
+static int released;
+
+static void waiter(void * arg) {
+  mutex_lock(&herd_mutex);
+  ++parked;
+  while(!released) {
+    condition_wait(&herd, &herd_mutex);
+  }
+  mutex_unlock(&herd_mutex);
+}
+
+double bench_broadcast(int num_kthreads, long ops) {
+  struct thread ** threads = malloc(sizeof(struct thread *) * ops);
+  long i;
+
+  mutex_init(&herd_mutex);
+  condition_init(&herd);
+  parked = 0;
+  released = 0;
+
+  for(i = 0; i < ops; ++i) {
+    threads[i] = thread_fork(waiter, NULL);
+  }
+  mutex_lock(&herd_mutex);
+  while(parked < ops) {
+    mutex_unlock(&herd_mutex);
+    yield();
+    mutex_lock(&herd_mutex);
+  }
+
+  released = 1;
+  double start = now_ns();
+  condition_broadcast(&herd);
+  double elapsed = now_ns() - start;
+  mutex_unlock(&herd_mutex);
+
+  for(i = 0; i < ops; ++i) {
+    thread_join(threads[i]);
+  }
+  free(threads);
+  return elapsed / 1e3;
+}
@@ -0,0 +1,165 @@
+/* CS533 Assignment 5
+ * io.c: File scanning benchmarks
+ *
+ * Each sample scans a file of ops blocks of SCAN_BLOCK bytes with readv_wrap,
+ * split between a number of reader threads, each reading its own contiguous
+ * part of the file through its own file descriptor. Every reader checksums
+ * what it reads, so there is some work to overlap with the I/O. Returns MB/s.
+ *
+ * The file is created in $TMPDIR (or /tmp) on the first sample and unlinked
+ * right away. With the default scale it fits in the page cache, so this
+ * measures the cost of the I/O path rather than of the disk; raise -s to make
+ * it larger than memory.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "aio_batch.h"
+#include "bench.h"
+#include "scheduler.h"
+
+#define SCAN_BLOCK (64 * 1024)
+
+static int scan_fd = -1;
+static long scan_blocks;
+static unsigned long scan_checksum;
+
+struct scanner {
+  long first, blocks;
+  int readahead;
+  unsigned long checksum;
+  int failed;
+};
+
+/* Create the file once per process; the block contents depend on their
+ * position, so a block read from the wrong place changes the checksum.
+ */
+static int create_file(long blocks) {
+  char path[256];
+  const char * dir = getenv("TMPDIR");
+  unsigned char * block = malloc(SCAN_BLOCK);
+  long b;
+  int i;
+
+  snprintf(path, sizeof(path), "%s/bench_scan.XXXXXX", dir ? dir : "/tmp");
+  scan_fd = mkstemp(path);
+  if(scan_fd < 0) {
+    perror("mkstemp");
+    free(block);
+    return -1;
+  }
+  unlink(path);
+
+  scan_checksum = 0;
+  for(b = 0; b < blocks; ++b) {
+    for(i = 0; i < SCAN_BLOCK; ++i) {
+      block[i] = (unsigned char)(b * 31 + i * 7);
+      scan_checksum += block[i];
+    }
+    if(write(scan_fd, block, SCAN_BLOCK) != SCAN_BLOCK) {
+      perror("write");
+      free(block);
+      return -1;
+    }
+  }
+
+  scan_blocks = blocks;
+  free(block);
+  return 0;
+}
+
+static void scanner(void * arg) {
+  struct scanner * s = arg;
+  unsigned char * buf = malloc(SCAN_BLOCK);
+  char path[64];
+  long b;
+  int i;
+
+  /* a new open file description, with its own offset */
+  snprintf(path, sizeof(path), "/proc/self/fd/%d", scan_fd);
+  int fd = open(path, O_RDONLY);
+  if(fd < 0) {
+    s->failed = 1;
+    free(buf);
+    return;
+  }
+  if(s->readahead) {
+    readahead_enable(fd, SCAN_BLOCK);
+  }
+  lseek(fd, s->first * SCAN_BLOCK, SEEK_SET);
+
+  struct iovec iov[2] = {
+    { buf, SCAN_BLOCK / 2 },
+    { buf + SCAN_BLOCK / 2, SCAN_BLOCK / 2 }
+  };
+
+  for(b = 0; b < s->blocks; ++b) {
+    if(readv_wrap(fd, iov, 2) != SCAN_BLOCK) {
+      s->failed = 1;
+      break;
+    }
+    for(i = 0; i < SCAN_BLOCK; ++i) {
+      s->checksum += buf[i];
+    }
+  }
+
+  if(s->readahead) {
+    readahead_disable(fd);
+  }
+  close(fd);
+  free(buf);
+}
+
+static double scan(long ops, int readers, int readahead) {
+  struct scanner scanners[readers];
+  struct thread * threads[readers];
+  unsigned long checksum = 0;
+  int i, failed = 0;
+
+  if(scan_fd < 0 && create_file(ops) < 0) {
+    return -1;
+  }
+
+  double start = now_ns();
+  for(i = 0; i < readers; ++i) {
+    scanners[i].first = scan_blocks * i / readers;
+    scanners[i].blocks = scan_blocks * (i + 1) / readers - scanners[i].first;
+    scanners[i].readahead = readahead;
+    scanners[i].checksum = 0;
+    scanners[i].failed = 0;
+    threads[i] = thread_fork(scanner, &scanners[i]);
+  }
+  for(i = 0; i < readers; ++i) {
+    thread_join(threads[i]);
+    checksum += scanners[i].checksum;
+    failed |= scanners[i].failed;
+  }
+  double elapsed = now_ns() - start;
+
+  if(failed || checksum != scan_checksum) {
+    return -1;
+  }
+  return scan_blocks * (double)SCAN_BLOCK / 1e6 / (elapsed / 1e9);
+}
+
+double bench_scan_1(int num_kthreads, long ops) {
+  return scan(ops, 1, 0);
+}
+
+double bench_scan_64(int num_kthreads, long ops) {
+  return scan(ops, 64, 0);
+}
+
+double bench_scan_ra_1(int num_kthreads, long ops) {
+  return scan(ops, 1, 1);
+}
+
+double bench_scan_ra_64(int num_kthreads, long ops) {
+  return scan(ops, 64, 1);
+}
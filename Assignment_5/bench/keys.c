@@ -0,0 +1,113 @@
+/* CS533 Assignment 5
+ * keys.c: Thread-specific data benchmarks
+ *
+ * One thread per kernel thread looks up a key ops times, yielding every
+ * KEY_YIELD_EVERY lookups so that the threads on a kernel thread take
+ * turns. Both return ns per lookup per thread.
+ *
+ *   getspecific           thread_getspecific; only if scheduler.h defines
+ *                         THREAD_KEYS. Every thread sets its own value and
+ *                         checks every lookup, and the key's destructor
+ *                         counts the threads that exit; returns -1 if a
+ *                         thread ever sees another's value or a destructor
+ *                         does not run.
+ *   pthread_getspecific   pthread_getspecific, for comparison. The kernel
+ *                         threads share their pthread's data, so every
+ *                         thread sees the same value.
+ */
+
+#include <pthread.h>
+
+#include "bench.h"
+#include "scheduler.h"
+
+#define KEY_YIELD_EVERY 1024
+
+static long lookups;
+static volatile AO_t errors;
+
+static double run_threads(int num_kthreads, long ops, void (*fn)(void *)) {
+  struct thread * threads[num_kthreads];
+  int i;
+
+  lookups = ops;
+  AO_store(&errors, 0);
+
+  double start = now_ns();
+  for(i = 0; i < num_kthreads; ++i) {
+    threads[i] = thread_fork(fn, NULL);
+  }
+  for(i = 0; i < num_kthreads; ++i) {
+    thread_join(threads[i]);
+  }
+  return (now_ns() - start) / ops;
+}
+
+#ifdef THREAD_KEYS
+
+static thread_key_t key;
+static int key_created;
+static volatile AO_t destroyed;
+
+static void count_destroyed(void * value) {
+  AO_fetch_and_add1_full(&destroyed);
+}
+
+static void specific_looker(void * arg) {
+  long i, mismatches = 0;
+  int me = 0;
+
+  thread_setspecific(key, &me);
+  for(i = 0; i < lookups; ++i) {
+    mismatches += thread_getspecific(key) != &me;
+    if(i % KEY_YIELD_EVERY == 0) {
+      yield();
+    }
+  }
+  if(mismatches) {
+    AO_fetch_and_add1_full(&errors);
+  }
+}
+
+double bench_getspecific(int num_kthreads, long ops) {
+  if(!key_created) {
+    if(thread_key_create(&key, count_destroyed)) {
+      return -1;
+    }
+    key_created = 1;
+  }
+  AO_store(&destroyed, 0);
+
+  double ns = run_threads(num_kthreads, ops, specific_looker);
+  int ok = !AO_load(&errors) && AO_load(&destroyed) == (AO_t)num_kthreads;
+  return ok ? ns : -1;
+}
+
+#endif
+
+static pthread_key_t pkey;
+static pthread_once_t pkey_once = PTHREAD_ONCE_INIT;
+
+static void create_pkey(void) {
+  pthread_key_create(&pkey, NULL);
+  pthread_setspecific(pkey, &pkey);
+}
+
+static void pthread_looker(void * arg) {
+  long i, mismatches = 0;
+
+  for(i = 0; i < lookups; ++i) {
+    mismatches += pthread_getspecific(pkey) != &pkey;
+    if(i % KEY_YIELD_EVERY == 0) {
+      yield();
+    }
+  }
+  if(mismatches) {
+    AO_fetch_and_add1_full(&errors);
+  }
+}
+
+double bench_pthread_getspecific(int num_kthreads, long ops) {
+  pthread_once(&pkey_once, create_pkey);
+  return run_threads(num_kthreads, ops, pthread_looker);
+}
@@ -0,0 +1,236 @@
+/* CS533 Assignment 5
+ * macro.c: Application-level benchmarks
+ *
+ * The parallel mergesort is the one from sort_test.c. Each sample sorts a
+ * fresh array of ops elements from datagen_fill, in the distribution given
+ * with -d, and returns the sort time in milliseconds. Sample i of every run
+ * uses seed i, counting from 1, so runs sort the same arrays; the warm-up
+ * uses seed 1 as well.
+ *
+ * The array and large merge buffers come from huge_alloc rather than malloc,
+ * so they are always fresh pages on the merging kernel thread's node, backed
+ * by huge pages or not according to KTHREAD_HUGEPAGES. Smaller ones come from
+ * malloc, or for sort_talloc, from thread_alloc.
+ *
+ * The mixed benchmarks run ops units of computation alongside one thread per
+ * kernel thread that keeps making a blocking system call, and return the time
+ * the computation took in milliseconds.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "datagen.h"
+#include "elastic.h"
+#include "hugepage.h"
+#include "thread_alloc.h"
+#include "bench.h"
+#include "scheduler.h"
+
+#define SEQ_THRESHOLD 100
+
+struct array {
+  int * arr;
+  int len;
+};
+
+static int use_thread_alloc;
+
+static void selection_sort(struct array * A) {
+  int * arr = A->arr;
+  int length = A->len;
+
+  int i,j,min,temp;
+  for(i = 0; i < length-1; ++i) {
+
+    min = i;
+
+    for(j = i+1; j < length; ++j) {
+      if(arr[j] < arr[min]) {
+        min = j;
+      }
+    }
+
+    temp = arr[i];
+    arr[i] = arr[min];
+    arr[min] = temp;
+  }
+}
+
+static void merge(struct array * A, struct array * B) {
+  int * arr1 = A->arr;
+  int l1     = A->len;
+
+  int * arr2 = B->arr;
+  int l2     = B->len;
+
+  size_t bytes = sizeof(int) * (l1 + l2);
+  int * result;
+  if(bytes >= HUGE_ALLOC_MIN) {
+    result = huge_alloc(bytes);
+  } else if(use_thread_alloc) {
+    result = thread_alloc(bytes);
+  } else {
+    result = malloc(bytes);
+  }
+
+  int i = 0, j = 0, k = 0;
+
+  while(i < l1 && j < l2) {
+    if(arr1[i] < arr2[j]) {
+      result[k++] = arr1[i++];
+    } else {
+      result[k++] = arr2[j++];
+    }
+  }
+
+  if(i >= l1) {
+    memcpy(result+k, arr2+j, sizeof(int) * (l2-j));
+  } else if(j >= l2) {
+    memcpy(result+k, arr1+i, sizeof(int) * (l1-i));
+  }
+
+  memcpy(arr1, result, bytes);
+
+  if(bytes >= HUGE_ALLOC_MIN) {
+    huge_free(result, bytes);
+  } else if(use_thread_alloc) {
+    thread_free(result);
+  } else {
+    free(result);
+  }
+}
+
+static void par_mergesort(void * arg) {
+  struct array * A = (struct array*)arg;
+
+  if(A->len <= SEQ_THRESHOLD) {
+    selection_sort(A);
+  }
+
+  else {
+    struct array left_half, right_half;
+
+    left_half.len  = A->len/2;
+    right_half.len = A->len - left_half.len;
+
+    left_half.arr  = A->arr;
+    right_half.arr = A->arr + left_half.len;
+
+    struct thread * left_t  = thread_fork(par_mergesort, &left_half);
+    struct thread * right_t = thread_fork(par_mergesort, &right_half);
+
+    thread_join(left_t);
+    thread_join(right_t);
+
+    merge(&left_half, &right_half);
+  }
+}
+
+static double sort(long ops) {
+  struct array A;
+  int i;
+
+  A.len = ops;
+  A.arr = huge_alloc(sizeof(int) * A.len);
+  datagen_fill(A.arr, A.len, sort_dist, ++sort_seed);
+
+  double start = now_ns();
+  par_mergesort(&A);
+  double elapsed = now_ns() - start;
+
+  for(i = 0; i < A.len-1; ++i) {
+    if(A.arr[i] > A.arr[i+1]) {
+      elapsed = -1;
+      break;
+    }
+  }
+
+  huge_free(A.arr, sizeof(int) * A.len);
+  return elapsed / 1e6;
+}
+
+double bench_sort(int num_kthreads, long ops) {
+  use_thread_alloc = 0;
+  return sort(ops);
+}
+
+double bench_sort_talloc(int num_kthreads, long ops) {
+  use_thread_alloc = 1;
+  return sort(ops);
+}
+
+
+/* Mixed blocking and compute: compute threads share ops units of work, while
+ * one sleeper per kernel thread sleeps for 1ms at a time with nanosleep,
+ * which blocks whichever kernel thread it is running on. Without spare
+ * kernel threads the computation only runs in the gaps between sleeps.
+ */
+
+#define UNIT_ITERS 20000
+
+static long units_per_thread;
+static volatile int computing;
+static int use_regions;
+
+static void compute(void * arg) {
+  volatile unsigned x = 1;
+  long i, j;
+
+  for(i = 0; i < units_per_thread; ++i) {
+    for(j = 0; j < UNIT_ITERS; ++j) {
+      x = x * 1103515245 + 12345;
+    }
+    yield();
+  }
+}
+
+static void sleeper(void * arg) {
+  struct timespec ms = { 0, 1000000 };
+
+  while(computing) {
+    if(use_regions) {
+      blocking_region_begin();
+    }
+    nanosleep(&ms, NULL);
+    if(use_regions) {
+      blocking_region_end();
+    }
+    yield();
+  }
+}
+
+static double mixed(int num_kthreads, long ops, int regions) {
+  struct thread * computers[num_kthreads];
+  struct thread * sleepers[num_kthreads];
+  int i;
+
+  units_per_thread = ops / num_kthreads;
+  use_regions = regions;
+  computing = 1;
+
+  double start = now_ns();
+  for(i = 0; i < num_kthreads; ++i) {
+    sleepers[i] = thread_fork(sleeper, NULL);
+    computers[i] = thread_fork(compute, NULL);
+  }
+  for(i = 0; i < num_kthreads; ++i) {
+    thread_join(computers[i]);
+  }
+  double elapsed = now_ns() - start;
+
+  computing = 0;
+  for(i = 0; i < num_kthreads; ++i) {
+    thread_join(sleepers[i]);
+  }
+  return elapsed / 1e6;
+}
+
+double bench_mixed(int num_kthreads, long ops) {
+  return mixed(num_kthreads, ops, 0);
+}
+
+double bench_mixed_region(int num_kthreads, long ops) {
+  return mixed(num_kthreads, ops, 1);
+}
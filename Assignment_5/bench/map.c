@@ -0,0 +1,252 @@
+/* CS533 Assignment 5
+ * map.c: Concurrent hash map benchmarks
+ *
+ * One thread per kernel thread, each doing ops operations on random keys
+ * and yielding every MAP_YIELD_EVERY of them. All return operations per
+ * second, over all threads, and -1 if a lookup ever gets a wrong value.
+ *
+ *   map_chained   lookups of MAP_KEYS keys in a copy of threadmap.c's table:
+ *                 7 chains of malloc'd entries behind one spinlock
+ *   map_cmap      lookups of the same keys in a cmap_t
+ *   map_cmap_put  ops keys per thread put into a cmap_t that starts out
+ *                 empty, looked up, removed and looked up again (four
+ *                 operations each), so that every segment grows several
+ *                 times while other threads are using it
+ *   map_cmap_churn  ops keys per thread put into a cmap_t in batches of
+ *                 random size, then all but the last MAP_CHURN_KEEP of each
+ *                 batch removed (two operations each), so that segments
+ *                 fill up with tombstones, shrink to a few entries and fill
+ *                 up again, the way a map of descriptors to waiters does
+ */
+
+#include "bench.h"
+#include "cmap.h"
+#include "scheduler.h"
+
+#define MAP_KEYS         1024
+#define MAP_YIELD_EVERY  1024
+#define CHAINED_BUCKETS  7
+#define MAP_CHURN_BATCH  4096    /* largest batch per thread */
+#define MAP_CHURN_KEEP   8
+
+/* Keys look like addresses of 16-byte objects, values are derived from
+ * keys so that any lookup can be checked */
+#define KEY(i)    (0x10000UL + 16UL * (unsigned long)(i))
+#define VALUE(k)  ((void *)((k) ^ 0x5a5a0000UL))
+
+struct chained_entry {
+  unsigned long key;
+  void * value;
+  struct chained_entry * next;
+};
+
+static struct chained_entry * chains[CHAINED_BUCKETS];
+static AO_TS_t chains_lock = AO_TS_INITIALIZER;
+static cmap_t * map;
+
+static long per_thread;
+static volatile AO_t errors;
+
+static unsigned long xorshift(unsigned long * x) {
+  *x ^= *x << 13;
+  *x ^= *x >> 7;
+  *x ^= *x << 17;
+  return *x;
+}
+
+static void * chained_get(unsigned long key) {
+  struct chained_entry * e;
+  void * value = NULL;
+
+  spinlock_lock(&chains_lock);
+  for(e = chains[key % CHAINED_BUCKETS]; e; e = e->next) {
+    if(e->key == key) {
+      value = e->value;
+      break;
+    }
+  }
+  spinlock_unlock(&chains_lock);
+  return value;
+}
+
+static void chained_put(unsigned long key, void * value) {
+  struct chained_entry * e = malloc(sizeof(struct chained_entry));
+  e->key = key;
+  e->value = value;
+  e->next = chains[key % CHAINED_BUCKETS];
+  chains[key % CHAINED_BUCKETS] = e;
+}
+
+static void chained_free(void) {
+  int i;
+  for(i = 0; i < CHAINED_BUCKETS; ++i) {
+    while(chains[i]) {
+      struct chained_entry * next = chains[i]->next;
+      free(chains[i]);
+      chains[i] = next;
+    }
+  }
+}
+
+static void chained_looker(void * arg) {
+  unsigned long x = 88172645463325252UL + (unsigned long)arg, key;
+  long i, mismatches = 0;
+
+  for(i = 0; i < per_thread; ++i) {
+    key = KEY(xorshift(&x) % MAP_KEYS);
+    mismatches += chained_get(key) != VALUE(key);
+    if(i % MAP_YIELD_EVERY == 0) {
+      yield();
+    }
+  }
+  if(mismatches) {
+    AO_fetch_and_add1_full(&errors);
+  }
+}
+
+static void cmap_looker(void * arg) {
+  unsigned long x = 88172645463325252UL + (unsigned long)arg, key;
+  long i, mismatches = 0;
+
+  for(i = 0; i < per_thread; ++i) {
+    key = KEY(xorshift(&x) % MAP_KEYS);
+    mismatches += cmap_get(map, key) != VALUE(key);
+    if(i % MAP_YIELD_EVERY == 0) {
+      yield();
+    }
+  }
+  if(mismatches) {
+    AO_fetch_and_add1_full(&errors);
+  }
+}
+
+/* Thread n owns the keys KEY(n), KEY(n + num_kthreads), ... past MAP_KEYS,
+ * so it can check that nobody else's writes disturb them */
+static int num_writers;
+
+static void cmap_writer(void * arg) {
+  long n = (long)arg, i, mismatches = 0;
+  unsigned long key;
+
+  for(i = 0; i < per_thread; ++i) {
+    key = KEY(MAP_KEYS + n + i * num_writers);
+    mismatches += cmap_put(map, key, VALUE(key)) != NULL;
+    mismatches += cmap_get(map, key) != VALUE(key);
+    if(i % MAP_YIELD_EVERY == 0) {
+      yield();
+    }
+  }
+  for(i = 0; i < per_thread; ++i) {
+    key = KEY(MAP_KEYS + n + i * num_writers);
+    mismatches += cmap_remove(map, key) != VALUE(key);
+    mismatches += cmap_get(map, key) != NULL;
+  }
+  if(mismatches) {
+    AO_fetch_and_add1_full(&errors);
+  }
+}
+
+static void cmap_churner(void * arg) {
+  unsigned long x = 88172645463325252UL + (unsigned long)arg, key;
+  long n = (long)arg, i = 0, kept = 0, mismatches = 0, batch, j;
+
+  while(i < per_thread) {
+    batch = 1 + xorshift(&x) % MAP_CHURN_BATCH;
+    if(batch > per_thread - i) {
+      batch = per_thread - i;
+    }
+    for(j = i; j < i + batch; ++j) {
+      key = KEY(MAP_KEYS + n + j * num_writers);
+      mismatches += cmap_put(map, key, VALUE(key)) != NULL;
+      if(j % MAP_YIELD_EVERY == 0) {
+        yield();
+      }
+    }
+    i += batch;
+    /* remove the last batch's survivors, and all but a few of this one */
+    for(j = kept; j < i - MAP_CHURN_KEEP; ++j) {
+      key = KEY(MAP_KEYS + n + j * num_writers);
+      mismatches += cmap_remove(map, key) != VALUE(key);
+      if(j % MAP_YIELD_EVERY == 0) {
+        yield();
+      }
+    }
+    if(j > kept) {
+      kept = j;
+    }
+  }
+  for(j = kept; j < i; ++j) {
+    key = KEY(MAP_KEYS + n + j * num_writers);
+    mismatches += cmap_remove(map, key) != VALUE(key);
+  }
+  if(mismatches) {
+    AO_fetch_and_add1_full(&errors);
+  }
+}
+
+static double run_threads(int num_kthreads, long ops, void (*fn)(void *)) {
+  struct thread * threads[num_kthreads];
+  long i;
+
+  per_thread = ops;
+  num_writers = num_kthreads;
+  AO_store(&errors, 0);
+
+  double start = now_ns();
+  for(i = 0; i < num_kthreads; ++i) {
+    threads[i] = thread_fork(fn, (void *)i);
+  }
+  for(i = 0; i < num_kthreads; ++i) {
+    thread_join(threads[i]);
+  }
+  double seconds = (now_ns() - start) / 1e9;
+
+  return AO_load(&errors) ? -1 : num_kthreads * ops / seconds;
+}
+
+double bench_map_chained(int num_kthreads, long ops) {
+  int i;
+  for(i = 0; i < MAP_KEYS; ++i) {
+    chained_put(KEY(i), VALUE(KEY(i)));
+  }
+  double rate = run_threads(num_kthreads, ops, chained_looker);
+  chained_free();
+  return rate;
+}
+
+double bench_map_cmap(int num_kthreads, long ops) {
+  int i;
+  map = cmap_create(MAP_KEYS);
+  for(i = 0; i < MAP_KEYS; ++i) {
+    cmap_put(map, KEY(i), VALUE(KEY(i)));
+  }
+  double rate = run_threads(num_kthreads, ops, cmap_looker);
+  cmap_destroy(map);
+  return rate;
+}
+
+double bench_map_cmap_put(int num_kthreads, long ops) {
+  map = cmap_create(0);
+  double rate = run_threads(num_kthreads, ops, cmap_writer);
+  if(cmap_size(map) != 0) {
+    rate = -1;
+  }
+  if(rate > 0) {
+    rate *= 4;                   /* put, get, remove and get per key */
+  }
+  cmap_destroy(map);
+  return rate;
+}
+
+double bench_map_cmap_churn(int num_kthreads, long ops) {
+  map = cmap_create(0);
+  double rate = run_threads(num_kthreads, ops, cmap_churner);
+  if(cmap_size(map) != 0) {
+    rate = -1;
+  }
+  if(rate > 0) {
+    rate *= 2;                   /* put and remove per key */
+  }
+  cmap_destroy(map);
+  return rate;
+}
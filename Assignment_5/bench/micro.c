@@ -0,0 +1,233 @@
+/* CS533 Assignment 5
+ * micro.c: Microbenchmarks for the scheduler primitives
+ *
+ * Every function here returns the average cost of one operation in
+ * nanoseconds, except fork_exit, which reports a throughput.
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "scheduler.h"
+
+/* Yield ping-pong: two threads yield back and forth */
+
+static long yield_ops;
+
+static void yielder(void * arg) {
+  long i;
+  for(i = 0; i < yield_ops; ++i) {
+    yield();
+  }
+}
+
+double bench_yield(int num_kthreads, long ops) {
+  yield_ops = ops;
+
+  double start = now_ns();
+  struct thread * a = thread_fork(yielder, NULL);
+  struct thread * b = thread_fork(yielder, NULL);
+  thread_join(a);
+  thread_join(b);
+
+  return (now_ns() - start) / (2 * ops);
+}
+
+
+/* Fork + join: create a thread that does nothing and wait for it */
+
+static void nothing(void * arg) {
+}
+
+double bench_fork_join(int num_kthreads, long ops) {
+  long i;
+
+  double start = now_ns();
+  for(i = 0; i < ops; ++i) {
+    thread_join(thread_fork(nothing, NULL));
+  }
+
+  return (now_ns() - start) / ops;
+}
+
+
+/* Fork + exit throughput: one forker per kernel thread keeps FORK_BATCH
+ * threads in flight, forking a batch and then joining it. The children finish
+ * on whichever kernel thread picks them up, so their TCBs are usually freed
+ * on a different kernel thread from the one that allocated them. Returns
+ * threads per second.
+ */
+
+#define FORK_BATCH 16
+
+static long fork_exit_ops;
+
+static void forker(void * arg) {
+  struct thread * batch[FORK_BATCH];
+  long i;
+  int j;
+
+  for(i = 0; i < fork_exit_ops; i += FORK_BATCH) {
+    for(j = 0; j < FORK_BATCH; ++j) {
+      batch[j] = thread_fork(nothing, NULL);
+    }
+    for(j = 0; j < FORK_BATCH; ++j) {
+      thread_join(batch[j]);
+    }
+  }
+}
+
+double bench_fork_exit(int num_kthreads, long ops) {
+  struct thread * forkers[num_kthreads];
+  int i;
+
+  fork_exit_ops = ops / num_kthreads;
+
+  double start = now_ns();
+  for(i = 0; i < num_kthreads; ++i) {
+    forkers[i] = thread_fork(forker, NULL);
+  }
+  for(i = 0; i < num_kthreads; ++i) {
+    thread_join(forkers[i]);
+  }
+  double elapsed = now_ns() - start;
+
+  long forked = num_kthreads *
+                ((fork_exit_ops + FORK_BATCH - 1) / FORK_BATCH) * FORK_BATCH;
+  return forked / (elapsed / 1e9);
+}
+
+/* Mutex handoff: two threads yield while holding the lock, so every
+ * acquisition blocks and is handed over by mutex_unlock
+ */
+
+static struct mutex handoff_mutex;
+static long mutex_ops;
+
+static void locker(void * arg) {
+  long i;
+  for(i = 0; i < mutex_ops; ++i) {
+    mutex_lock(&handoff_mutex);
+    yield();
+    mutex_unlock(&handoff_mutex);
+  }
+}
+
+double bench_mutex(int num_kthreads, long ops) {
+  mutex_init(&handoff_mutex);
+  mutex_ops = ops;
+
+  double start = now_ns();
+  struct thread * a = thread_fork(locker, NULL);
+  struct thread * b = thread_fork(locker, NULL);
+  thread_join(a);
+  thread_join(b);
+
+  return (now_ns() - start) / (2 * ops);
+}
+
+
+/* Condition variable latency: two threads take turns, each one signaling
+ * the other and then waiting for its own turn to come back around
+ */
+
+static struct mutex turn_mutex;
+static struct condition turn_changed;
+static int turn;
+static long condition_ops;
+
+static void taker(void * arg) {
+  int me = (int)(long)arg;
+  long i;
+  for(i = 0; i < condition_ops; ++i) {
+    mutex_lock(&turn_mutex);
+    while(turn != me) {
+      condition_wait(&turn_changed, &turn_mutex);
+    }
+    turn = !me;
+    condition_signal(&turn_changed);
+    mutex_unlock(&turn_mutex);
+  }
+}
+
+double bench_condition(int num_kthreads, long ops) {
+  mutex_init(&turn_mutex);
+  condition_init(&turn_changed);
+  turn = 0;
+  condition_ops = ops;
+
+  double start = now_ns();
+  struct thread * a = thread_fork(taker, (void*)0);
+  struct thread * b = thread_fork(taker, (void*)1);
+  thread_join(a);
+  thread_join(b);
+
+  return (now_ns() - start) / (2 * ops);
+}
+
+
+/* read_wrap on a pipe: the data is already there, so this measures the cost
+ * of one submit/poll/complete cycle
+ */
+
+#define PIPE_MSG 64
+
+double bench_read_wrap(int num_kthreads, long ops) {
+  int fds[2];
+  char buf[PIPE_MSG] = {0};
+  long i;
+
+  if(pipe(fds) < 0) {
+    return -1;
+  }
+
+  double start = now_ns();
+  for(i = 0; i < ops; ++i) {
+    write(fds[1], buf, PIPE_MSG);
+    read_wrap(fds[0], buf, PIPE_MSG);
+  }
+  double elapsed = now_ns() - start;
+
+  close(fds[0]);
+  close(fds[1]);
+  return elapsed / ops;
+}
+
+
+/* Spinlock contention: one thread per kernel thread hammers on the same
+ * spinlock
+ */
+
+static AO_TS_t contended = AO_TS_INITIALIZER;
+static long spinlock_ops;
+static volatile long spinlock_counter;
+
+static void spinner(void * arg) {
+  long i;
+  for(i = 0; i < spinlock_ops; ++i) {
+    spinlock_lock(&contended);
+    ++spinlock_counter;
+    spinlock_unlock(&contended);
+  }
+}
+
+double bench_spinlock(int num_kthreads, long ops) {
+  struct thread ** spinners = malloc(sizeof(struct thread *) * num_kthreads);
+  int i;
+
+  spinlock_ops = ops;
+  spinlock_counter = 0;
+
+  double start = now_ns();
+  for(i = 0; i < num_kthreads; ++i) {
+    spinners[i] = thread_fork(spinner, NULL);
+  }
+  for(i = 0; i < num_kthreads; ++i) {
+    thread_join(spinners[i]);
+  }
+  double elapsed = now_ns() - start;
+
+  free(spinners);
+  return elapsed / ((double)num_kthreads * ops);
+}
@@ -0,0 +1,55 @@
+/* CS533 Assignment 5
+ * primes.c: Prime sieve benchmarks
+ *
+ *   primes      count the primes up to ops
+ *   nth_prime   find the ops-th prime
+ *
+ * Both return ms, or -1 if ops is one of the values in the tables below and
+ * the answer is wrong. With -s, primes goes up to 10^10 with -s 100.
+ */
+
+#include "bench.h"
+#include "primes.h"
+
+static const long pi[][2] = {
+  { 1000000L, 78498L },
+  { 10000000L, 664579L },
+  { 100000000L, 5761455L },
+  { 1000000000L, 50847534L },
+  { 10000000000L, 455052511L },
+};
+
+static const long nth[][2] = {
+  { 1000000L, 15485863L },
+  { 5000000L, 86028121L },
+  { 10000000L, 179424673L },
+  { 50000000L, 982451653L },
+  { 100000000L, 2038074743L },
+  { 500000000L, 11037271757L },
+};
+
+static int check(const long table[][2], int n, long x, long answer) {
+  int i;
+  for(i = 0; i < n; ++i) {
+    if(table[i][0] == x) {
+      return table[i][1] == answer;
+    }
+  }
+  return 1;
+}
+
+double bench_primes(int num_kthreads, long ops) {
+  double start = now_ns();
+  long count = primes_count(ops);
+  double elapsed = now_ns() - start;
+
+  return check(pi, sizeof(pi) / sizeof(pi[0]), ops, count) ? elapsed / 1e6 : -1;
+}
+
+double bench_nth_prime(int num_kthreads, long ops) {
+  double start = now_ns();
+  long p = primes_nth(ops);
+  double elapsed = now_ns() - start;
+
+  return check(nth, sizeof(nth) / sizeof(nth[0]), ops, p) ? elapsed / 1e6 : -1;
+}
@@ -0,0 +1,314 @@
+/* CS533 Assignment 5
+ * serve.c: Loopback file server benchmarks
+ *
+ * Two connections per kernel thread over TCP on 127.0.0.1. For each, a
+ * server thread sends a SERVE_FILE_SIZE-byte file over and over until it
+ * has sent its share of ops megabytes, and a client thread receives it and
+ * throws it away with MSG_TRUNC, which copies nothing. Every socket is
+ * non-blocking; threads wait for them with fd_wait. The file is created in
+ * $TMPDIR (or /tmp) on the first sample and unlinked right away, so it is
+ * served from the page cache. A client that gets the wrong number of bytes
+ * gives -1.
+ *
+ *   serve_copy       read_wrap SERVE_CHUNK bytes into a buffer, then write
+ *   serve_sendfile   sendfile_wrap from the file to the socket
+ *   serve_splice     splice_wrap from the file into a pipe, and from the
+ *                    pipe into the socket
+ *
+ * All three return MB/s. The same with _cpu return the CPU time the process
+ * used per GB, user and system, over all kernel threads (ms/GB).
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+#include "bench.h"
+#include "scheduler.h"
+#include "zerocopy.h"
+
+#define SERVE_FILE_SIZE (8L * 1024 * 1024)
+#define SERVE_CHUNK     (64 * 1024)
+
+typedef enum { COPY, SENDFILE, SPLICE } serve_t;
+
+struct connection {
+  serve_t method;
+  int listener;
+  long bytes;                    /* to send and receive */
+  long received;
+  int failed;
+};
+
+static int serve_fd = -1;
+static struct sockaddr_in serve_addr;
+
+static int create_file(void) {
+  char path[256];
+  const char * dir = getenv("TMPDIR");
+  char * block = malloc(SERVE_CHUNK);
+  long done;
+  int i;
+
+  snprintf(path, sizeof(path), "%s/bench_serve.XXXXXX", dir ? dir : "/tmp");
+  serve_fd = mkstemp(path);
+  if(serve_fd < 0) {
+    perror("mkstemp");
+    free(block);
+    return -1;
+  }
+  unlink(path);
+
+  for(done = 0; done < SERVE_FILE_SIZE; done += SERVE_CHUNK) {
+    for(i = 0; i < SERVE_CHUNK; ++i) {
+      block[i] = (char)(done / SERVE_CHUNK * 31 + i * 7);
+    }
+    if(write(serve_fd, block, SERVE_CHUNK) != SERVE_CHUNK) {
+      perror("write");
+      free(block);
+      return -1;
+    }
+  }
+  free(block);
+  return 0;
+}
+
+/* write all of buf to a non-blocking socket */
+static int write_all(int fd, const char * buf, size_t count) {
+  while(count > 0) {
+    ssize_t n = write(fd, buf, count);
+    if(n < 0 && errno == EAGAIN) {
+      fd_wait(fd, POLLOUT);
+    } else if(n <= 0) {
+      return -1;
+    } else {
+      buf += n;
+      count -= n;
+    }
+  }
+  return 0;
+}
+
+static int serve_copy(int sock, long bytes) {
+  char path[64];
+  char * buf = malloc(SERVE_CHUNK);
+  int fd, failed = 0;
+
+  /* a new open file description, with its own offset */
+  snprintf(path, sizeof(path), "/proc/self/fd/%d", serve_fd);
+  if((fd = open(path, O_RDONLY)) < 0) {
+    free(buf);
+    return -1;
+  }
+
+  while(bytes > 0 && !failed) {
+    ssize_t n = read_wrap(fd, buf, bytes < SERVE_CHUNK ? bytes : SERVE_CHUNK);
+    if(n == 0) {
+      lseek(fd, 0, SEEK_SET);
+    } else if(n < 0 || write_all(sock, buf, n) < 0) {
+      failed = 1;
+    } else {
+      bytes -= n;
+    }
+  }
+  close(fd);
+  free(buf);
+  return failed ? -1 : 0;
+}
+
+static int serve_sendfile(int sock, long bytes) {
+  off_t offset = 0;
+
+  while(bytes > 0) {
+    long left = SERVE_FILE_SIZE - offset;
+    ssize_t n = sendfile_wrap(sock, serve_fd, &offset, bytes < left ? bytes : left);
+    if(n <= 0) {
+      return -1;
+    }
+    bytes -= n;
+    if(offset == SERVE_FILE_SIZE) {
+      offset = 0;
+    }
+  }
+  return 0;
+}
+
+static int serve_splice(int sock, long bytes) {
+  loff_t offset = 0;
+  int pipe_fds[2], failed = 0;
+
+  if(pipe2(pipe_fds, O_NONBLOCK) < 0) {
+    return -1;
+  }
+  while(bytes > 0 && !failed) {
+    long left = SERVE_FILE_SIZE - offset;
+    if(left > SERVE_CHUNK) {
+      left = SERVE_CHUNK;
+    }
+    ssize_t in = splice_wrap(serve_fd, &offset, pipe_fds[1], NULL,
+                             bytes < left ? bytes : left, SPLICE_F_MOVE);
+    if(in <= 0) {
+      failed = 1;
+      break;
+    }
+    bytes -= in;
+    if(offset == SERVE_FILE_SIZE) {
+      offset = 0;
+    }
+    while(in > 0) {
+      ssize_t out = splice_wrap(pipe_fds[0], NULL, sock, NULL, in,
+                                SPLICE_F_MOVE | (bytes > 0 ? SPLICE_F_MORE : 0));
+      if(out <= 0) {
+        failed = 1;
+        break;
+      }
+      in -= out;
+    }
+  }
+  close_wrap(pipe_fds[0]);
+  close_wrap(pipe_fds[1]);
+  return failed ? -1 : 0;
+}
+
+static void server(void * arg) {
+  struct connection * c = arg;
+  int sock;
+
+  while((sock = accept4(c->listener, NULL, NULL, SOCK_NONBLOCK)) < 0) {
+    if(errno != EAGAIN || fd_wait(c->listener, POLLIN) < 0) {
+      c->failed = 1;
+      return;
+    }
+  }
+
+  int result = c->method == COPY     ? serve_copy(sock, c->bytes) :
+               c->method == SENDFILE ? serve_sendfile(sock, c->bytes) :
+                                       serve_splice(sock, c->bytes);
+  if(result < 0) {
+    c->failed = 1;
+  }
+  close_wrap(sock);
+}
+
+static void client(void * arg) {
+  struct connection * c = arg;
+  int sock = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+
+  if(sock < 0) {
+    c->failed = 1;
+    return;
+  }
+  if(connect(sock, (struct sockaddr *)&serve_addr, sizeof(serve_addr)) < 0) {
+    if(errno != EINPROGRESS) {
+      c->failed = 1;
+      close(sock);
+      return;
+    }
+    fd_wait(sock, POLLOUT);
+  }
+
+  while(1) {
+    ssize_t n = recv(sock, NULL, 4 * SERVE_CHUNK, MSG_TRUNC);
+    if(n > 0) {
+      c->received += n;
+    } else if(n < 0 && errno == EAGAIN) {
+      fd_wait(sock, POLLIN);
+    } else {
+      break;
+    }
+  }
+  close_wrap(sock);
+}
+
+static double cpu_ns(void) {
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1e9 +
+         (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1e3;
+}
+
+/* MB/s, and CPU ms per GB in *cpu */
+static double serve(int num_kthreads, long ops, serve_t method, double * cpu) {
+  int n = 2 * num_kthreads, i, failed = 0;
+  struct connection connections[n];
+  struct thread * threads[2 * n];
+  socklen_t len = sizeof(serve_addr);
+  long bytes = ops * 1024 * 1024 / n;
+
+  if(serve_fd < 0 && create_file() < 0) {
+    return -1;
+  }
+
+  int listener = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+  memset(&serve_addr, 0, sizeof(serve_addr));
+  serve_addr.sin_family = AF_INET;
+  serve_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if(listener < 0 ||
+     bind(listener, (struct sockaddr *)&serve_addr, sizeof(serve_addr)) < 0 ||
+     listen(listener, n) < 0 ||
+     getsockname(listener, (struct sockaddr *)&serve_addr, &len) < 0) {
+    perror("serve: listen");
+    return -1;
+  }
+
+  double start = now_ns(), cpu_start = cpu_ns();
+  for(i = 0; i < n; ++i) {
+    connections[i].method = method;
+    connections[i].listener = listener;
+    connections[i].bytes = bytes;
+    connections[i].received = 0;
+    connections[i].failed = 0;
+    threads[2 * i] = thread_fork(server, &connections[i]);
+    threads[2 * i + 1] = thread_fork(client, &connections[i]);
+  }
+  for(i = 0; i < 2 * n; ++i) {
+    thread_join(threads[i]);
+  }
+  double elapsed = now_ns() - start;
+  *cpu = (cpu_ns() - cpu_start) / 1e6 / (bytes * n / 1e9);
+
+  close_wrap(listener);
+  for(i = 0; i < n; ++i) {
+    failed |= connections[i].failed || connections[i].received != bytes;
+  }
+  return failed ? -1 : bytes * n / 1e6 / (elapsed / 1e9);
+}
+
+double bench_serve_copy(int num_kthreads, long ops) {
+  double cpu;
+  return serve(num_kthreads, ops, COPY, &cpu);
+}
+
+double bench_serve_sendfile(int num_kthreads, long ops) {
+  double cpu;
+  return serve(num_kthreads, ops, SENDFILE, &cpu);
+}
+
+double bench_serve_splice(int num_kthreads, long ops) {
+  double cpu;
+  return serve(num_kthreads, ops, SPLICE, &cpu);
+}
+
+double bench_serve_copy_cpu(int num_kthreads, long ops) {
+  double cpu;
+  return serve(num_kthreads, ops, COPY, &cpu) < 0 ? -1 : cpu;
+}
+
+double bench_serve_sendfile_cpu(int num_kthreads, long ops) {
+  double cpu;
+  return serve(num_kthreads, ops, SENDFILE, &cpu) < 0 ? -1 : cpu;
+}
+
+double bench_serve_splice_cpu(int num_kthreads, long ops) {
+  double cpu;
+  return serve(num_kthreads, ops, SPLICE, &cpu) < 0 ? -1 : cpu;
+}
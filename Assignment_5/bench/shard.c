@@ -0,0 +1,116 @@
+/* CS533 Assignment 5
+ * shard.c: Scheduler instance benchmarks
+ *
+ * These need a scheduler with instances (see the "Scheduler Instances"
+ * section of README.md), and are only built if scheduler.h defines
+ * SCHEDULER_INSTANCES, and not in the uniprocessor build.
+ *
+ *   pairs_shared    one pair of threads per kernel thread, all in the default
+ *                   scheduler, each pair yielding back and forth
+ *   pairs_sharded   the same, but with each pair on a scheduler of its own
+ *                   with one kernel thread; returns ns per yield per pair
+ *   local_wake      two threads in the default scheduler passing a message
+ *                   back and forth over a pair of channels
+ *   cross_wake      the same, with one of them on another scheduler; returns
+ *                   ns per round trip
+ *
+ * The shards are created the first time they are needed and kept for the
+ * rest of the process, since schedulers are never destroyed. Their kernel
+ * threads come on top of the ones scheduler_begin created.
+ */
+
+#include <stdlib.h>
+
+#include "bench.h"
+#include "channel.h"
+#include "scheduler.h"
+
+#if defined(SCHEDULER_INSTANCES) && !defined(UNIPROCESSOR)
+
+#define MAX_SHARDS 256
+
+static scheduler_t * shards[MAX_SHARDS];
+static long rounds;
+
+static scheduler_t * shard(int i) {
+  if(!shards[i]) {
+    shards[i] = scheduler_create(1);
+  }
+  return shards[i];
+}
+
+static void yielder(void * arg) {
+  long i;
+  for(i = 0; i < rounds; ++i) {
+    yield();
+  }
+}
+
+static double pairs(int num_kthreads, long ops, int sharded) {
+  int n = num_kthreads > MAX_SHARDS ? MAX_SHARDS : num_kthreads, i;
+  struct thread * threads[2 * n];
+
+  for(i = 0; sharded && i < n; ++i) {
+    shard(i);
+  }
+  rounds = ops;
+
+  double start = now_ns();
+  for(i = 0; i < 2 * n; ++i) {
+    threads[i] = sharded ? thread_fork_on(shard(i / 2), yielder, NULL)
+                         : thread_fork(yielder, NULL);
+  }
+  for(i = 0; i < 2 * n; ++i) {
+    thread_join(threads[i]);
+  }
+  return (now_ns() - start) / ops;
+}
+
+double bench_pairs_shared(int num_kthreads, long ops) {
+  return pairs(num_kthreads, ops, 0);
+}
+
+double bench_pairs_sharded(int num_kthreads, long ops) {
+  return pairs(num_kthreads, ops, 1);
+}
+
+static channel_t * ping, * pong;
+
+static void echo(void * arg) {
+  long i;
+  for(i = 0; i < rounds; ++i) {
+    chan_send(pong, chan_recv(ping));
+  }
+}
+
+static double round_trips(long ops, scheduler_t * where) {
+  long i, ok = 1;
+
+  ping = chan_create(1);
+  pong = chan_create(1);
+  rounds = ops;
+
+  double start = now_ns();
+  struct thread * t = where ? thread_fork_on(where, echo, NULL)
+                            : thread_fork(echo, NULL);
+  for(i = 0; i < ops; ++i) {
+    chan_send(ping, (void *)(i + 1));
+    ok &= chan_recv(pong) == (void *)(i + 1);
+  }
+  thread_join(t);
+  double elapsed = now_ns() - start;
+
+  chan_destroy(ping);
+  chan_destroy(pong);
+  return ok ? elapsed / ops : -1;
+}
+
+double bench_local_wake(int num_kthreads, long ops) {
+  return round_trips(ops, NULL);
+}
+
+double bench_cross_wake(int num_kthreads, long ops) {
+  return round_trips(ops, shard(0));
+}
+
+#endif
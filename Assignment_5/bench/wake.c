@@ -0,0 +1,136 @@
+/* CS533 Assignment 5
+ * wake.c: Cache-affine wakeup benchmarks
+ *
+ * One pair of threads per kernel thread takes turns through a mutex and a
+ * condition variable. On its turn, a thread adds one to every word of a
+ * WAKE_WORKING_SET-byte array of its own, which fits in an L2 cache, then
+ * hands the turn to the other thread and waits for it to come back. Each
+ * thread takes ops turns; the arrays are checked at the end, and a wrong
+ * count gives -1.
+ *
+ * Only if scheduler.h defines AFFINE_WAKEUPS:
+ *
+ *   wake_affine     ns per turn, with KTHREAD_MIGRATION_COST or its default
+ *   wake_shared     ns per turn, with a migration cost of 0, so that every
+ *                   woken thread goes on the ready list
+ *   migrate_affine  migrations per second counted by affine.c, over all
+ *                   kernel threads, during the same run as wake_affine
+ *   migrate_shared  the same, for wake_shared
+ *
+ * Run with -l to see the L2 misses of each.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "scheduler.h"
+
+#ifdef AFFINE_WAKEUPS
+
+#define WAKE_WORKING_SET (64 * 1024)
+#define WAKE_WORDS       (WAKE_WORKING_SET / sizeof(long))
+
+struct pair {
+  struct mutex m;
+  struct condition c;
+  int turn;
+  long turns;                    /* for each thread */
+  long * data[2];
+};
+
+struct player {
+  struct pair * pair;
+  int me;
+};
+
+static void play(void * arg) {
+  struct player * p = arg;
+  struct pair * pair = p->pair;
+  long * data = pair->data[p->me];
+  long i, j;
+
+  for(i = 0; i < pair->turns; ++i) {
+    mutex_lock(&pair->m);
+    while(pair->turn != p->me) {
+      condition_wait(&pair->c, &pair->m);
+    }
+    mutex_unlock(&pair->m);
+
+    for(j = 0; j < (long)WAKE_WORDS; ++j) {
+      ++data[j];
+    }
+
+    mutex_lock(&pair->m);
+    pair->turn = !p->me;
+    condition_signal(&pair->c);
+    mutex_unlock(&pair->m);
+  }
+}
+
+/* ns per turn, and migrations per second in *rate */
+static double run_pairs(int num_kthreads, long ops, long cost, double * rate) {
+  struct pair pairs[num_kthreads];
+  struct player players[2 * num_kthreads];
+  struct thread * threads[2 * num_kthreads];
+  long saved = affine_migration_cost();
+  int i, ok = 1;
+  long j;
+
+  for(i = 0; i < num_kthreads; ++i) {
+    mutex_init(&pairs[i].m);
+    condition_init(&pairs[i].c);
+    pairs[i].turn = 0;
+    pairs[i].turns = ops;
+    pairs[i].data[0] = malloc(WAKE_WORKING_SET);
+    pairs[i].data[1] = malloc(WAKE_WORKING_SET);
+    memset(pairs[i].data[0], 0, WAKE_WORKING_SET);
+    memset(pairs[i].data[1], 0, WAKE_WORKING_SET);
+  }
+
+  affine_set_migration_cost(cost);
+  unsigned long migrations = affine_migrations();
+  double start = now_ns();
+  for(i = 0; i < 2 * num_kthreads; ++i) {
+    players[i].pair = &pairs[i / 2];
+    players[i].me = i % 2;
+    threads[i] = thread_fork(play, &players[i]);
+  }
+  for(i = 0; i < 2 * num_kthreads; ++i) {
+    thread_join(threads[i]);
+  }
+  double elapsed = now_ns() - start;
+  *rate = (affine_migrations() - migrations) / (elapsed / 1e9);
+  affine_set_migration_cost(saved);
+
+  for(i = 0; i < num_kthreads; ++i) {
+    for(j = 0; j < (long)WAKE_WORDS; ++j) {
+      ok &= pairs[i].data[0][j] == ops && pairs[i].data[1][j] == ops;
+    }
+    free(pairs[i].data[0]);
+    free(pairs[i].data[1]);
+  }
+  return ok ? elapsed / (2 * ops) : -1;
+}
+
+double bench_wake_affine(int num_kthreads, long ops) {
+  double rate;
+  return run_pairs(num_kthreads, ops, affine_migration_cost(), &rate);
+}
+
+double bench_wake_shared(int num_kthreads, long ops) {
+  double rate;
+  return run_pairs(num_kthreads, ops, 0, &rate);
+}
+
+double bench_migrate_affine(int num_kthreads, long ops) {
+  double rate;
+  return run_pairs(num_kthreads, ops, affine_migration_cost(), &rate) < 0 ? -1 : rate;
+}
+
+double bench_migrate_shared(int num_kthreads, long ops) {
+  double rate;
+  return run_pairs(num_kthreads, ops, 0, &rate) < 0 ? -1 : rate;
+}
+
+#endif
@@ -0,0 +1,397 @@
+/* CS533 Assignment 5
+ * channel.c: Bounded multi-producer, multi-consumer channels
+ *
+ * The ring buffer is Dmitry Vyukov's bounded MPMC queue: every slot carries a
+ * sequence number that tells producers and consumers whose turn it is to use
+ * the slot, so the only shared writes are one CAS on head or tail.
+ *
+ * Blocking works like the mutex in Part 4, except that the spinlock passed to
+ * block() belongs to the waiting thread rather than to the channel:
+ *
+ *   waiter                                 waker
+ *     lock w.lock
+ *     add w to ch's wait list
+ *     re-check the ring: still empty
+ *     state = BLOCKED
+ *     block(&w.lock)                         push message
+ *       lock ready                           see a waiter; take w off the list
+ *       unlock w.lock                        claim w.fired
+ *       switch ...                           lock w.lock  (w has switched out)
+ *                                            unblock(w.t)
+ *
+ * Adding w to the list and re-checking the ring on one side, and pushing and
+ * then checking the wait count on the other, are both separated by full
+ * barriers, so at least one of the two sides always sees the other.
+ *
+ * A waker takes up to WAKE_BATCH waiters off a list at a time. If the
+ * scheduler has unblock_many (see BATCHED_WAKEUPS in README.md), each batch
+ * goes onto the ready list with one acquisition of its lock.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "channel.h"
+#include "scheduler.h"
+
+struct chan_slot {
+  volatile AO_t seq;
+  void * msg;
+};
+
+/* One parked thread. fired is claimed by whoever wakes the thread, so a
+ * thread parked on several channels by chan_select is only woken once.
+ */
+struct chan_wait {
+  struct thread * t;
+  volatile AO_t fired;
+  AO_TS_t lock;
+  channel_t * from;
+};
+
+/* A chan_wait's entry on one channel's wait list */
+struct chan_link {
+  struct chan_wait * w;
+  struct chan_link * next;
+  struct chan_link ** pprev;
+};
+
+/* How many threads one pass of wake() collects while holding ch->lock */
+#define WAKE_BATCH 16
+
+/* chan_select parks on up to this many channels without calling malloc */
+#define SELECT_LOCAL 8
+
+#define WAITLIST(ch, for_room) ((for_room) ? &(ch)->senders : &(ch)->receivers)
+
+
+static void waitlist_init(struct chan_waitlist * list) {
+  list->head = NULL;
+  list->tail = &list->head;
+  list->count = 0;
+}
+
+channel_t * chan_create(unsigned capacity) {
+  /* the sequence numbers cannot tell a full slot from an empty one in a
+   * ring of one slot */
+  unsigned size = 2, i;
+  if(capacity > CHAN_MAX_CAPACITY) {
+    return NULL;
+  }
+  while(size < capacity) {
+    size <<= 1;
+  }
+
+  channel_t * ch = malloc(sizeof(channel_t));
+  if(!ch) {
+    return NULL;
+  }
+  ch->slots = malloc(sizeof(struct chan_slot) * size);
+  if(!ch->slots) {
+    free(ch);
+    return NULL;
+  }
+  for(i = 0; i < size; ++i) {
+    ch->slots[i].seq = i;
+  }
+  ch->mask = size - 1;
+  ch->head = ch->tail = 0;
+
+  AO_CLEAR(&ch->lock);
+  waitlist_init(&ch->receivers);
+  waitlist_init(&ch->senders);
+  return ch;
+}
+
+void chan_destroy(channel_t * ch) {
+  free(ch->slots);
+  free(ch);
+}
+
+
+/* Ring buffer */
+
+static int push(channel_t * ch, void * msg) {
+  AO_t pos = AO_load(&ch->tail);
+  while(1) {
+    struct chan_slot * slot = &ch->slots[pos & ch->mask];
+    long dif = (long)(AO_load_acquire(&slot->seq) - pos);
+
+    if(dif == 0) {
+      if(AO_compare_and_swap(&ch->tail, pos, pos + 1)) {
+        slot->msg = msg;
+        AO_store_release(&slot->seq, pos + 1);
+        return 1;
+      }
+    } else if(dif < 0) {
+      return 0;   /* full */
+    }
+    pos = AO_load(&ch->tail);
+  }
+}
+
+static int pop(channel_t * ch, void ** msg) {
+  AO_t pos = AO_load(&ch->head);
+  while(1) {
+    struct chan_slot * slot = &ch->slots[pos & ch->mask];
+    long dif = (long)(AO_load_acquire(&slot->seq) - (pos + 1));
+
+    if(dif == 0) {
+      if(AO_compare_and_swap(&ch->head, pos, pos + 1)) {
+        *msg = slot->msg;
+        AO_store_release(&slot->seq, pos + ch->mask + 1);
+        return 1;
+      }
+    } else if(dif < 0) {
+      return 0;   /* empty */
+    }
+    pos = AO_load(&ch->head);
+  }
+}
+
+/* Non-destructive versions of push and pop, used to re-check the ring after
+ * joining a wait list
+ */
+static int has_room(channel_t * ch) {
+  while(1) {
+    AO_t pos = AO_load(&ch->tail);
+    long dif = (long)(AO_load_acquire(&ch->slots[pos & ch->mask].seq) - pos);
+    if(dif <= 0) {
+      return dif == 0;
+    }
+  }
+}
+
+static int has_message(channel_t * ch) {
+  while(1) {
+    AO_t pos = AO_load(&ch->head);
+    long dif = (long)(AO_load_acquire(&ch->slots[pos & ch->mask].seq) - (pos + 1));
+    if(dif <= 0) {
+      return dif == 0;
+    }
+  }
+}
+
+
+/* Wait lists; ch->lock must be held */
+
+static void link_waiter(struct chan_waitlist * list, struct chan_link * l) {
+  l->next = NULL;
+  l->pprev = list->tail;
+  *list->tail = l;
+  list->tail = &l->next;
+  AO_fetch_and_add1_full(&list->count);
+}
+
+static void unlink_waiter(struct chan_waitlist * list, struct chan_link * l) {
+  if(!l->pprev) {
+    return;
+  }
+  *l->pprev = l->next;
+  if(l->next) {
+    l->next->pprev = l->pprev;
+  } else {
+    list->tail = l->pprev;
+  }
+  l->pprev = NULL;
+  AO_fetch_and_sub1(&list->count);
+}
+
+
+/* Wake up to max threads parked on list. Called after every successful push
+ * (for receivers) or pop (for senders); does nothing but a fence and a load
+ * unless someone is actually waiting.
+ */
+static void wake(channel_t * ch, struct chan_waitlist * list, int max) {
+  AO_nop_full();
+
+  while(max > 0 && AO_load(&list->count)) {
+    struct chan_wait * woken[WAKE_BATCH];
+    int n = 0, i, more;
+
+    spinlock_lock(&ch->lock);
+    while(n < max && n < WAKE_BATCH && list->head) {
+      struct chan_link * l = list->head;
+      unlink_waiter(list, l);
+
+      /* skip chan_select waiters that another channel already woke */
+      if(AO_compare_and_swap_full(&l->w->fired, 0, 1)) {
+        l->w->from = ch;
+        woken[n++] = l->w;
+      }
+    }
+    more = list->head != NULL;
+    spinlock_unlock(&ch->lock);
+
+    /* w lives on the parked thread's stack: once it is unblocked, w may
+     * disappear, so w.lock is never released here */
+#ifdef BATCHED_WAKEUPS
+    struct thread * threads[WAKE_BATCH];
+    for(i = 0; i < n; ++i) {
+      spinlock_lock(&woken[i]->lock);
+      threads[i] = woken[i]->t;
+    }
+    unblock_many(threads, n);
+#else
+    for(i = 0; i < n; ++i) {
+      spinlock_lock(&woken[i]->lock);
+      unblock(woken[i]->t);
+    }
+#endif
+
+    max -= n;
+    if(!more) {
+      break;
+    }
+  }
+}
+
+static void park(struct chan_wait * w) {
+  current_thread->state = BLOCKED;
+  block(&w->lock);
+}
+
+/* Park the current thread on the senders (for_room) or receivers list of
+ * each of the n channels, unless one of them becomes ready in the meantime.
+ * Returns once the thread has been woken or found a ready channel; the
+ * caller retries its push or pop either way.
+ */
+static void wait_on(channel_t ** chans, int n, int for_room) {
+  struct chan_link local[SELECT_LOCAL];
+  struct chan_link * links = n <= SELECT_LOCAL ? local
+                                               : malloc(sizeof(struct chan_link) * n);
+  struct chan_wait w;
+  int i, ready = 0;
+
+  w.t = current_thread;
+  w.fired = 0;
+  w.from = NULL;
+  AO_CLEAR(&w.lock);
+  spinlock_lock(&w.lock);
+
+  for(i = 0; i < n; ++i) {
+    links[i].w = &w;
+    spinlock_lock(&chans[i]->lock);
+    link_waiter(WAITLIST(chans[i], for_room), &links[i]);
+    spinlock_unlock(&chans[i]->lock);
+  }
+
+  for(i = 0; i < n && !ready; ++i) {
+    ready = for_room ? has_room(chans[i]) : has_message(chans[i]);
+  }
+
+  if(!ready) {
+    park(&w);
+  } else if(AO_compare_and_swap_full(&w.fired, 0, 1)) {
+    spinlock_unlock(&w.lock);
+  } else {
+    /* a waker has already claimed us and is waiting to unblock us; let it,
+     * then hand the wakeup on, since we did not need it */
+    park(&w);
+    wake(w.from, WAITLIST(w.from, for_room), 1);
+  }
+
+  for(i = 0; i < n; ++i) {
+    spinlock_lock(&chans[i]->lock);
+    unlink_waiter(WAITLIST(chans[i], for_room), &links[i]);
+    spinlock_unlock(&chans[i]->lock);
+  }
+
+  if(links != local) {
+    free(links);
+  }
+}
+
+
+/* Public interface */
+
+int chan_try_send(channel_t * ch, void * msg) {
+  if(!push(ch, msg)) {
+    return 0;
+  }
+  wake(ch, &ch->receivers, 1);
+  return 1;
+}
+
+int chan_try_recv(channel_t * ch, void ** msg) {
+  if(!pop(ch, msg)) {
+    return 0;
+  }
+  wake(ch, &ch->senders, 1);
+  return 1;
+}
+
+void chan_send_many(channel_t * ch, void ** msgs, int n) {
+  int sent = 0;
+  while(1) {
+    int pushed = 0;
+    while(sent < n && push(ch, msgs[sent])) {
+      ++sent;
+      ++pushed;
+    }
+    if(pushed) {
+      wake(ch, &ch->receivers, pushed);
+    }
+    if(sent == n) {
+      return;
+    }
+    wait_on(&ch, 1, 1);
+  }
+}
+
+int chan_recv_many(channel_t * ch, void ** msgs, int n) {
+  int received = 0;
+  while(1) {
+    while(received < n && pop(ch, &msgs[received])) {
+      ++received;
+    }
+    if(received) {
+      wake(ch, &ch->senders, received);
+      return received;
+    }
+    wait_on(&ch, 1, 0);
+  }
+}
+
+void chan_send(channel_t * ch, void * msg) {
+  chan_send_many(ch, &msg, 1);
+}
+
+void * chan_recv(channel_t * ch) {
+  void * msg;
+  chan_recv_many(ch, &msg, 1);
+  return msg;
+}
+
+/* Where a select starts looking. Kernel threads share one TLS block, so there
+ * is nothing per thread to keep a counter in, and a counter shared by every
+ * select would be one more contended cache line; the low bits of the clock
+ * are different on every call and cost no shared write.
+ */
+static int select_start(int n) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  unsigned long x = (unsigned long)ts.tv_nsec * 0x9e3779b97f4a7c15UL;
+  return (int)((x >> 32) % (unsigned long)n);
+}
+
+int chan_select(channel_t ** chans, int n, void ** msg) {
+  int i;
+
+  if(n <= 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  while(1) {
+    /* start at a different channel each time so none of them starves */
+    int start = select_start(n);
+    for(i = 0; i < n; ++i) {
+      int c = (start + i) % n;
+      if(chan_try_recv(chans[c], msg)) {
+        return c;
+      }
+    }
+    wait_on(chans, n, 0);
+  }
+}
@@ -0,0 +1,82 @@
+/* CS533 Assignment 5
+ * channel.h: Bounded multi-producer, multi-consumer channels
+ *
+ * A channel carries void * messages between user-level threads, which may be
+ * running on different kernel threads. Messages live in a fixed-size,
+ * lock-free ring buffer, so a send or receive that does not have to wait
+ * costs a compare-and-swap and no spinlock at all. A thread that finds the
+ * channel full (or empty) parks itself with block() and is put back on the
+ * ready list with unblock() by the thread that makes room (or sends).
+ *
+ * See the "Channels" section of README.md for the scheduler hooks this file
+ * needs.
+ */
+
+#ifndef CHANNEL_H
+#define CHANNEL_H
+
+#include <atomic_ops.h>
+
+#define CHAN_CACHE_LINE 64
+
+struct chan_slot;
+struct chan_link;
+
+/* FIFO of parked threads; count can be read without holding the lock */
+struct chan_waitlist {
+  struct chan_link * head;
+  struct chan_link ** tail;
+  volatile AO_t count;
+};
+
+typedef struct channel {
+  /* ring buffer; head and tail are on their own cache lines so that
+   * producers and consumers do not false-share */
+  struct chan_slot * slots;
+  AO_t mask;
+  char pad0[CHAN_CACHE_LINE - sizeof(void *) - sizeof(AO_t)];
+  volatile AO_t head;
+  char pad1[CHAN_CACHE_LINE - sizeof(AO_t)];
+  volatile AO_t tail;
+  char pad2[CHAN_CACHE_LINE - sizeof(AO_t)];
+
+  /* parked threads, protected by lock; senders and receivers only take the
+   * lock when the other side's count says someone is waiting */
+  AO_TS_t lock;
+  struct chan_waitlist receivers;
+  struct chan_waitlist senders;
+} channel_t;
+
+/* The largest power of two an unsigned can hold */
+#define CHAN_MAX_CAPACITY (1u << 31)
+
+/* capacity is rounded up to a power of two, and is at least 2. Returns NULL
+ * if capacity is more than CHAN_MAX_CAPACITY, or if there is not enough
+ * memory.
+ */
+channel_t * chan_create(unsigned capacity);
+void chan_destroy(channel_t * ch);
+
+/* Block until the message has been sent / a message has been received */
+void chan_send(channel_t * ch, void * msg);
+void * chan_recv(channel_t * ch);
+
+/* Never block. Return 1 on success, 0 if the channel is full / empty */
+int chan_try_send(channel_t * ch, void * msg);
+int chan_try_recv(channel_t * ch, void ** msg);
+
+/* Batched versions: send all n messages, blocking while the channel is full,
+ * or receive between 1 and n messages, blocking only while it is empty.
+ * Parked threads on the other side are woken once per batch rather than once
+ * per message. chan_recv_many returns the number of messages received.
+ */
+void chan_send_many(channel_t * ch, void ** msgs, int n);
+int chan_recv_many(channel_t * ch, void ** msgs, int n);
+
+/* Receive one message from whichever of the n channels has one first.
+ * Returns the index of that channel in chans, or -1 with errno set to
+ * EINVAL if n is not positive.
+ */
+int chan_select(channel_t ** chans, int n, void ** msg);
+
+#endif
@@ -0,0 +1,427 @@
+/* CS533 Assignment 5
+ * cmap.c: Concurrent hash map
+ *
+ * A key's hash picks its segment (the low bits) and its home bucket (the
+ * rest). It is stored in the first free slot from its home bucket on,
+ * moving to the next bucket when one is full. A search stops at the first
+ * bucket with an empty slot. Removing a key leaves a tombstone behind, so
+ * that searches keep going past it; tombstones are dropped when the segment
+ * gets a new table.
+ *
+ * Every bucket has a sequence number that writers make odd while they
+ * change the bucket and even again when they are done. A reader reads the
+ * sequence number, the slots and the sequence number again, and starts over
+ * if the bucket changed in between: a seqlock. Writers only ever change a
+ * bucket with their segment's lock held.
+ *
+ * Growing a segment:
+ *
+ *   writer that fills it                   later writers
+ *     old = cur, cur = new table             move CMAP_MIGRATE_BATCH of
+ *     epoch++                                  old's buckets to cur
+ *                                            first, move every bucket of
+ *                                              old their key could be in
+ *                                            ...
+ *                                            last to move: old = NULL,
+ *                                              epoch++
+ *
+ * A moved bucket keeps its entries, but is flagged, and its table's next
+ * points to the table they were moved to. Writers never change old except
+ * to flag buckets, and only write a key to cur once every bucket of old
+ * that the key could be in is flagged. So a reader searches old first,
+ * skipping flagged buckets: if it finds the key there, that is its value,
+ * and if it finds no flags, the key is in neither table. Otherwise the key
+ * is in old's next if anywhere, and the reader searches that, and so on. If
+ * it runs out of tables, cur has been replaced in the meantime, and it
+ * starts over. A reader that saw old == NULL without the epoch changing
+ * from when it started could not have missed anything in old either.
+ *
+ * Moving buckets could fill cur before old is empty, if old was large and
+ * mostly tombstones. Then the writer gives the segment a new table for all
+ * of its entries, and moves every bucket of cur to it, then the rest of
+ * old: by the time any entry of old moves past cur, every bucket of cur is
+ * flagged, so a reader that follows old's next to cur goes on to the new
+ * table.
+ */
+
+#include <string.h>
+
+#include "affinity.h"
+#include "cmap.h"
+#include "scheduler.h"
+
+#define CMAP_CACHE_LINE 64
+
+
+struct cmap_bucket {
+  volatile AO_t seq;             /* odd while a writer changes the bucket */
+  volatile AO_t moved;           /* set once moved to the next table */
+  volatile AO_t keys[CMAP_BUCKET_SLOTS];
+  volatile AO_t values[CMAP_BUCKET_SLOTS];
+};
+
+struct cmap_table {
+  struct cmap_bucket * buckets;  /* node_alloc, so zeroed: all CMAP_EMPTY */
+  size_t mask;                   /* number of buckets - 1 */
+  size_t used;                   /* entries and tombstones */
+  struct cmap_table * volatile next;  /* where moved buckets went */
+  struct cmap_table * replaced;  /* the table before this one */
+};
+
+/* Everything but the table pointers and epoch is protected by lock */
+struct cmap_segment {
+  AO_TS_t lock;
+  struct cmap_table * volatile cur;
+  struct cmap_table * volatile old;
+  volatile AO_t epoch;           /* bumped when old is set or cleared */
+  size_t migrate_next;           /* next bucket of old to move */
+  volatile AO_t live;            /* entries */
+};
+
+union cmap_segment_line {
+  struct cmap_segment s;
+  char pad[2 * CMAP_CACHE_LINE];
+};
+
+struct cmap {
+  union cmap_segment_line segments[CMAP_SEGMENTS];
+};
+
+/* MurmurHash3's finalizer: every bit of the key affects every bit */
+static unsigned long hash(unsigned long key) {
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdUL;
+  key ^= key >> 33;
+  key *= 0xc4ceb9fe1a85ec53UL;
+  key ^= key >> 33;
+  return key;
+}
+
+static size_t home(struct cmap_table * t, unsigned long h) {
+  return (h / CMAP_SEGMENTS) & t->mask;
+}
+
+static struct cmap_table * table_create(size_t buckets) {
+  struct cmap_table * t = node_alloc(sizeof(struct cmap_table));
+  t->buckets = node_alloc(sizeof(struct cmap_bucket) * buckets);
+  t->mask = buckets - 1;
+  t->used = 0;
+  t->next = NULL;
+  t->replaced = NULL;
+  return t;
+}
+
+/* The fewest buckets, at least CMAP_MIN_BUCKETS, that keep n entries at
+ * most half full */
+static size_t buckets_for(size_t n) {
+  size_t buckets = CMAP_MIN_BUCKETS;
+  while(buckets * CMAP_BUCKET_SLOTS < 2 * n) {
+    buckets *= 2;
+  }
+  return buckets;
+}
+
+/* Lock-free search of one table, skipping moved buckets: 1 if key was
+ * found, and whether any bucket it could be in had been moved */
+static int table_find(struct cmap_table * t, unsigned long h,
+                      unsigned long key, void ** value, int * moved) {
+  size_t b = home(t, h), n;
+
+  *moved = 0;
+  for(n = 0; n <= t->mask; ++n, b = (b + 1) & t->mask) {
+    struct cmap_bucket * bucket = &t->buckets[b];
+    AO_t seq, v = 0;
+    int i, found, empty, flagged;
+
+    do {
+      while((seq = AO_load_acquire(&bucket->seq)) & 1) {
+      }
+      flagged = AO_load_acquire(&bucket->moved);
+      found = empty = 0;
+      for(i = 0; i < CMAP_BUCKET_SLOTS; ++i) {
+        AO_t k = AO_load_acquire(&bucket->keys[i]);
+        if(k == key) {
+          v = AO_load_acquire(&bucket->values[i]);
+          found = 1;
+        }
+        empty |= k == CMAP_EMPTY;
+      }
+    } while(AO_load_acquire(&bucket->seq) != seq);
+
+    if(flagged) {
+      *moved = 1;
+    } else if(found) {
+      *value = (void *)v;
+      return 1;
+    }
+    if(empty) {
+      break;
+    }
+  }
+  return 0;
+}
+
+void * cmap_get(cmap_t * m, unsigned long key) {
+  unsigned long h = hash(key);
+  struct cmap_segment * s = &m->segments[h & (CMAP_SEGMENTS - 1)].s;
+  void * value = NULL;
+  int moved;
+
+  while(1) {
+    AO_t epoch = AO_load_acquire(&s->epoch);
+    struct cmap_table * cur = s->cur;
+    AO_nop_full();
+    struct cmap_table * old = s->old;
+    struct cmap_table * t = old ? old : cur;
+
+    while(t) {
+      if(table_find(t, h, key, &value, &moved)) {
+        return value;
+      }
+      if(!moved) {
+        if(t == old || AO_load_acquire(&s->epoch) == epoch) {
+          return NULL;
+        }
+        break;
+      }
+      t = t->next;
+    }
+  }
+}
+
+/* The rest is for writers, with the segment's lock held */
+
+static void bucket_begin(struct cmap_bucket * bucket) {
+  AO_fetch_and_add1_full(&bucket->seq);
+}
+
+static void bucket_end(struct cmap_bucket * bucket) {
+  AO_store_release(&bucket->seq, bucket->seq + 1);
+}
+
+/* Slot of key in t, or else the first free slot on its way (if any), and
+ * whether key is there */
+static int table_slot(struct cmap_table * t, unsigned long h, unsigned long key,
+                      struct cmap_bucket ** where, int * slot) {
+  size_t b = home(t, h), n;
+  int i;
+
+  *where = NULL;
+  for(n = 0; n <= t->mask; ++n, b = (b + 1) & t->mask) {
+    struct cmap_bucket * bucket = &t->buckets[b];
+    int empty = 0;
+    for(i = 0; i < CMAP_BUCKET_SLOTS; ++i) {
+      AO_t k = bucket->keys[i];
+      if(k == key) {
+        *where = bucket;
+        *slot = i;
+        return 1;
+      }
+      if((k == CMAP_EMPTY || k == CMAP_TOMBSTONE) && !*where) {
+        *where = bucket;
+        *slot = i;
+      }
+      empty |= k == CMAP_EMPTY;
+    }
+    if(empty) {
+      break;
+    }
+  }
+  return 0;
+}
+
+/* Put key, which is not in t, into the free slot table_slot found */
+static void slot_fill(struct cmap_table * t, struct cmap_bucket * bucket, int slot,
+                      unsigned long key, void * value) {
+  bucket_begin(bucket);
+  if(bucket->keys[slot] == CMAP_EMPTY) {
+    ++t->used;
+  }
+  AO_store(&bucket->values[slot], (AO_t)value);
+  AO_store(&bucket->keys[slot], key);
+  bucket_end(bucket);
+}
+
+/* Whether adding n entries would make t more than 3/4 full, counting
+ * tombstones */
+static int table_full(struct cmap_table * t, size_t n) {
+  return 4 * (t->used + n) > 3 * (t->mask + 1) * CMAP_BUCKET_SLOTS;
+}
+
+/* Move bucket's entries to t, which has room for them */
+static void bucket_move(struct cmap_table * t, struct cmap_bucket * bucket) {
+  struct cmap_bucket * where;
+  int i, slot;
+
+  if(bucket->moved) {
+    return;
+  }
+  for(i = 0; i < CMAP_BUCKET_SLOTS; ++i) {
+    AO_t k = bucket->keys[i];
+    if(k != CMAP_EMPTY && k != CMAP_TOMBSTONE) {
+      table_slot(t, hash(k), k, &where, &slot);
+      slot_fill(t, where, slot, k, (void *)bucket->values[i]);
+    }
+  }
+  bucket_begin(bucket);
+  AO_store(&bucket->moved, 1);
+  bucket_end(bucket);
+}
+
+/* Give the segment a new table, big enough for its entries and one more.
+ * If old is not empty yet, move everything to the new table right away,
+ * cur first. */
+static void grow(struct cmap_segment * s) {
+  struct cmap_table * t = table_create(buckets_for(s->live + 1));
+  size_t b;
+
+  t->replaced = s->cur;
+  s->cur->next = t;
+  AO_nop_full();
+
+  if(s->old) {
+    for(b = 0; b <= s->cur->mask; ++b) {
+      bucket_move(t, &s->cur->buckets[b]);
+    }
+    for(; s->migrate_next <= s->old->mask; ++s->migrate_next) {
+      bucket_move(t, &s->old->buckets[s->migrate_next]);
+    }
+    s->old = NULL;
+  } else {
+    s->old = s->cur;
+    s->migrate_next = 0;
+  }
+  AO_nop_full();
+  s->cur = t;
+  AO_fetch_and_add1_full(&s->epoch);
+}
+
+/* Move one bucket of old, growing instead if cur might not have room */
+static void migrate_bucket(struct cmap_segment * s, struct cmap_bucket * bucket) {
+  if(table_full(s->cur, CMAP_BUCKET_SLOTS)) {
+    grow(s);
+  } else {
+    bucket_move(s->cur, bucket);
+  }
+}
+
+/* Move every bucket of old that key could be in, then a batch more */
+static void migrate(struct cmap_segment * s, unsigned long h) {
+  struct cmap_table * old = s->old;
+  size_t b = home(old, h), n;
+  int i;
+
+  for(n = 0; n <= old->mask && s->old; ++n, b = (b + 1) & old->mask) {
+    struct cmap_bucket * bucket = &old->buckets[b];
+    int empty = 0;
+    for(i = 0; i < CMAP_BUCKET_SLOTS; ++i) {
+      empty |= bucket->keys[i] == CMAP_EMPTY;
+    }
+    migrate_bucket(s, bucket);
+    if(empty) {
+      break;
+    }
+  }
+
+  for(n = 0; n < CMAP_MIGRATE_BATCH && s->old && s->migrate_next <= old->mask; ++n) {
+    migrate_bucket(s, &old->buckets[s->migrate_next]);
+    ++s->migrate_next;
+  }
+  if(s->old && s->migrate_next > old->mask) {
+    s->old = NULL;
+    AO_fetch_and_add1_full(&s->epoch);
+  }
+}
+
+static struct cmap_segment * lock_segment(cmap_t * m, unsigned long h) {
+  struct cmap_segment * s = &m->segments[h & (CMAP_SEGMENTS - 1)].s;
+  spinlock_lock(&s->lock);
+  if(s->old) {
+    migrate(s, h);
+  }
+  return s;
+}
+
+void * cmap_put(cmap_t * m, unsigned long key, void * value) {
+  unsigned long h = hash(key);
+  struct cmap_segment * s = lock_segment(m, h);
+  struct cmap_bucket * where;
+  void * replaced = NULL;
+  int slot;
+
+  if(table_slot(s->cur, h, key, &where, &slot)) {
+    replaced = (void *)where->values[slot];
+    bucket_begin(where);
+    AO_store(&where->values[slot], (AO_t)value);
+    bucket_end(where);
+  } else {
+    /* keep every table at most 3/4 full, counting tombstones */
+    if(!where || table_full(s->cur, 1)) {
+      grow(s);
+      if(s->old) {
+        migrate(s, h);
+      }
+      table_slot(s->cur, h, key, &where, &slot);
+    }
+    slot_fill(s->cur, where, slot, key, value);
+    AO_fetch_and_add1(&s->live);
+  }
+
+  spinlock_unlock(&s->lock);
+  return replaced;
+}
+
+void * cmap_remove(cmap_t * m, unsigned long key) {
+  unsigned long h = hash(key);
+  struct cmap_segment * s = lock_segment(m, h);
+  struct cmap_bucket * where;
+  void * removed = NULL;
+  int slot;
+
+  if(table_slot(s->cur, h, key, &where, &slot)) {
+    removed = (void *)where->values[slot];
+    bucket_begin(where);
+    AO_store(&where->keys[slot], CMAP_TOMBSTONE);
+    bucket_end(where);
+    AO_fetch_and_sub1(&s->live);
+  }
+
+  spinlock_unlock(&s->lock);
+  return removed;
+}
+
+size_t cmap_size(cmap_t * m) {
+  size_t n = 0;
+  int i;
+  for(i = 0; i < CMAP_SEGMENTS; ++i) {
+    n += AO_load(&m->segments[i].s.live);
+  }
+  return n;
+}
+
+cmap_t * cmap_create(size_t capacity) {
+  cmap_t * m = node_alloc(sizeof(cmap_t));
+  size_t buckets = buckets_for(capacity / CMAP_SEGMENTS);
+  int i;
+
+  for(i = 0; i < CMAP_SEGMENTS; ++i) {
+    struct cmap_segment * s = &m->segments[i].s;
+    s->lock = AO_TS_INITIALIZER;
+    s->cur = table_create(buckets);
+  }
+  return m;
+}
+
+void cmap_destroy(cmap_t * m) {
+  int i;
+  for(i = 0; i < CMAP_SEGMENTS; ++i) {
+    struct cmap_table * t = m->segments[i].s.cur;
+    while(t) {
+      struct cmap_table * replaced = t->replaced;
+      node_free(t->buckets, sizeof(struct cmap_bucket) * (t->mask + 1));
+      node_free(t, sizeof(struct cmap_table));
+      t = replaced;
+    }
+  }
+  node_free(m, sizeof(cmap_t));
+}
@@ -0,0 +1,64 @@
+/* CS533 Assignment 5
+ * cmap.h: Concurrent hash map
+ *
+ * threadmap.c gets away with 7 chains, one lock and a malloc per entry
+ * because it only ever holds one entry per kernel thread. cmap_t is for
+ * maps that are bigger and busier, such as file descriptors to waiting
+ * threads or lock addresses to statistics:
+ *
+ *   - entries live in open-addressed buckets of CMAP_BUCKET_SLOTS keys and
+ *     values, one cache line each, so a lookup usually reads one line and
+ *     nothing is allocated per entry
+ *   - cmap_get takes no lock and writes nothing; it only retries if it
+ *     overlaps a write to a bucket it read
+ *   - the map is split into CMAP_SEGMENTS segments by hash, each with a
+ *     spinlock for writers, so writers to different segments never wait
+ *     for each other
+ *   - a segment that fills up gets a new table, and its entries are moved
+ *     over CMAP_MIGRATE_BATCH buckets at a time by the writes that follow,
+ *     so no single write pays for copying the whole segment
+ *
+ * Keys are any unsigned long except CMAP_EMPTY and CMAP_TOMBSTONE. A NULL
+ * value cannot be told apart from a missing key.
+ *
+ * A reader may still be looking at a segment's table after it has been
+ * replaced, so replaced tables are only freed by cmap_destroy. They add up
+ * to less than the final size of the map.
+ *
+ * See the "Concurrent Hash Map" section of README.md.
+ */
+
+#ifndef CMAP_H
+#define CMAP_H
+
+#include <stddef.h>
+
+#define CMAP_BUCKET_SLOTS   3
+#define CMAP_SEGMENTS       16      /* power of 2 */
+#define CMAP_MIN_BUCKETS    4       /* per segment; power of 2 */
+#define CMAP_MIGRATE_BATCH  8
+
+#define CMAP_EMPTY          0UL
+#define CMAP_TOMBSTONE      (~0UL)
+
+typedef struct cmap cmap_t;
+
+/* A map sized for about capacity entries; it grows as needed */
+cmap_t * cmap_create(size_t capacity);
+
+/* Only once nobody else is using the map */
+void cmap_destroy(cmap_t * m);
+
+/* key's value, or NULL if there is none */
+void * cmap_get(cmap_t * m, unsigned long key);
+
+/* Set key's value; returns the value it replaced, or NULL */
+void * cmap_put(cmap_t * m, unsigned long key, void * value);
+
+/* Remove key; returns its value, or NULL if there was none */
+void * cmap_remove(cmap_t * m, unsigned long key);
+
+/* The number of entries, as of some recent moment */
+size_t cmap_size(cmap_t * m);
+
+#endif
@@ -0,0 +1,199 @@
+/* CS533 Assignment 5
+ * datagen.c: Input arrays for the sort benchmarks
+ *
+ * The generator is xoshiro256** (Blackman and Vigna), seeded with four
+ * outputs of splitmix64 started from a mix of the seed and the block number.
+ * A number below n is taken from the top 32 bits of an output by
+ * multiplication rather than with %, which is faster and, for n well below
+ * 2^32, just as close to uniform.
+ *
+ * Zipf values come from inverting the distribution's continuous
+ * approximation, 1 / x^s on [1, n + 1), and rounding down, which is one pow()
+ * per value instead of a search through a table of n probabilities.
+ *
+ * Nearly-sorted swaps stay inside a block, so blocks never write to each
+ * other's elements.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "datagen.h"
+#include "scheduler.h"
+
+struct rng {
+  uint64_t s[4];
+};
+
+struct block {
+  int * arr;
+  int start, len;                /* of this block, within the array */
+  int total;                     /* length of the whole array */
+  dist_t dist;
+  unsigned long seed;
+};
+
+static const char * names[NUM_DISTS] = {
+  "random", "sorted", "reverse", "nearly-sorted", "few-unique", "zipf", "organ-pipe"
+};
+
+int dist_parse(const char * name) {
+  int i;
+  for(i = 0; i < NUM_DISTS; ++i) {
+    if(!strcmp(name, names[i])) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+const char * dist_name(dist_t dist) {
+  return names[dist];
+}
+
+static uint64_t splitmix64(uint64_t * x) {
+  uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+static void rng_seed(struct rng * r, unsigned long seed, int block) {
+  uint64_t x = seed;
+  x = splitmix64(&x) + (uint64_t)block;
+  int i;
+  for(i = 0; i < 4; ++i) {
+    r->s[i] = splitmix64(&x);
+  }
+}
+
+static uint64_t rotl(uint64_t x, int k) {
+  return (x << k) | (x >> (64 - k));
+}
+
+static uint64_t rng_next(struct rng * r) {
+  uint64_t * s = r->s;
+  uint64_t result = rotl(s[1] * 5, 7) * 9;
+  uint64_t t = s[1] << 17;
+
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = rotl(s[3], 45);
+  return result;
+}
+
+/* Uniform in [0, n) */
+static int rng_below(struct rng * r, int n) {
+  return (int)(((rng_next(r) >> 32) * (uint64_t)n) >> 32);
+}
+
+/* Uniform in [0, 1) */
+static double rng_unit(struct rng * r) {
+  return (rng_next(r) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static void fill_block(void * arg) {
+  struct block * b = arg;
+  int * arr = b->arr + b->start, n = b->total, i;
+  struct rng r;
+
+  rng_seed(&r, b->seed, b->start / DATAGEN_BLOCK);
+
+  switch(b->dist) {
+    case DIST_RANDOM:
+      for(i = 0; i < b->len; ++i) {
+        arr[i] = rng_below(&r, n);
+      }
+      break;
+
+    case DIST_SORTED:
+      for(i = 0; i < b->len; ++i) {
+        arr[i] = b->start + i;
+      }
+      break;
+
+    case DIST_REVERSE:
+      for(i = 0; i < b->len; ++i) {
+        arr[i] = n - 1 - (b->start + i);
+      }
+      break;
+
+    case DIST_NEARLY_SORTED:
+      for(i = 0; i < b->len; ++i) {
+        arr[i] = b->start + i;
+      }
+      for(i = 0; i < b->len / DATAGEN_NEARLY_SWAPS; ++i) {
+        int j = rng_below(&r, b->len);
+        int k = j + 1 + rng_below(&r, DATAGEN_NEARLY_DISTANCE);
+        if(k >= b->len) {
+          k = b->len - 1;
+        }
+        int temp = arr[j];
+        arr[j] = arr[k];
+        arr[k] = temp;
+      }
+      break;
+
+    case DIST_FEW_UNIQUE: {
+      int step = n / DATAGEN_FEW_UNIQUE > 0 ? n / DATAGEN_FEW_UNIQUE : 1;
+      for(i = 0; i < b->len; ++i) {
+        arr[i] = rng_below(&r, DATAGEN_FEW_UNIQUE) * step % n;
+      }
+      break;
+    }
+
+    case DIST_ZIPF: {
+      double a = 1 - DATAGEN_ZIPF_S, top = pow(n + 1.0, a) - 1;
+      for(i = 0; i < b->len; ++i) {
+        int k = (int)pow(top * rng_unit(&r) + 1, 1 / a);
+        arr[i] = k < 1 ? 0 : k > n ? n - 1 : k - 1;
+      }
+      break;
+    }
+
+    default: /* DIST_ORGAN_PIPE */
+      for(i = 0; i < b->len; ++i) {
+        int j = b->start + i;
+        arr[i] = j < n / 2 ? j : n - 1 - j;
+      }
+      break;
+  }
+}
+
+void datagen_fill(int * arr, int len, dist_t dist, unsigned long seed) {
+  int n = (len + DATAGEN_BLOCK - 1) / DATAGEN_BLOCK, i;
+  if(n == 0) {
+    return;
+  }
+
+  struct block * blocks = malloc(sizeof(struct block) * n);
+  struct thread ** threads = malloc(sizeof(struct thread *) * n);
+
+  for(i = 0; i < n; ++i) {
+    blocks[i].arr = arr;
+    blocks[i].start = i * DATAGEN_BLOCK;
+    blocks[i].len = i == n - 1 ? len - blocks[i].start : DATAGEN_BLOCK;
+    blocks[i].total = len;
+    blocks[i].dist = dist;
+    blocks[i].seed = seed;
+  }
+
+  if(n == 1) {
+    fill_block(&blocks[0]);
+  } else {
+    for(i = 0; i < n; ++i) {
+      threads[i] = thread_fork(fill_block, &blocks[i]);
+    }
+    for(i = 0; i < n; ++i) {
+      thread_join(threads[i]);
+    }
+  }
+
+  free(threads);
+  free(blocks);
+}
@@ -0,0 +1,56 @@
+/* CS533 Assignment 5
+ * datagen.h: Input arrays for the sort benchmarks
+ *
+ * rand() is slow, serial and seeded from the clock, so a large input took as
+ * long to make as to sort and was different every run. datagen_fill splits
+ * the array into blocks of DATAGEN_BLOCK elements and fills them in parallel,
+ * one user-level thread per block, each with a xoshiro256** generator of its
+ * own. A block's generator is seeded from the seed and the block's number
+ * alone, so the same seed gives the same array for any number of kernel
+ * threads.
+ *
+ * Every distribution has values from 0 to len - 1:
+ *
+ *   random          uniform
+ *   sorted          0, 1, 2, ...
+ *   reverse         ..., 2, 1, 0
+ *   nearly-sorted   sorted, then one element in DATAGEN_NEARLY_SWAPS swapped
+ *                   with one up to DATAGEN_NEARLY_DISTANCE places after it
+ *   few-unique      uniform over DATAGEN_FEW_UNIQUE values spread across the
+ *                   range
+ *   zipf            value k - 1 with probability roughly proportional to
+ *                   1 / k^DATAGEN_ZIPF_S
+ *   organ-pipe      0, 1, 2, ... up to the middle and back down again
+ */
+
+#ifndef DATAGEN_H
+#define DATAGEN_H
+
+#define DATAGEN_BLOCK            (64 * 1024)
+#define DATAGEN_NEARLY_SWAPS     100
+#define DATAGEN_NEARLY_DISTANCE  64
+#define DATAGEN_FEW_UNIQUE       16
+#define DATAGEN_ZIPF_S           1.1
+
+typedef enum {
+  DIST_RANDOM,
+  DIST_SORTED,
+  DIST_REVERSE,
+  DIST_NEARLY_SORTED,
+  DIST_FEW_UNIQUE,
+  DIST_ZIPF,
+  DIST_ORGAN_PIPE,
+  NUM_DISTS
+} dist_t;
+
+/* The distribution called name (as in the list above), or -1 */
+int dist_parse(const char * name);
+const char * dist_name(dist_t dist);
+
+/* Fill arr[0..len) from dist. Arrays of more than DATAGEN_BLOCK elements are
+ * filled by forked threads, so call it from a user-level thread, after
+ * scheduler_begin.
+ */
+void datagen_fill(int * arr, int len, dist_t dist, unsigned long seed);
+
+#endif
@@ -0,0 +1,292 @@
+/* CS533 Assignment 5
+ * elastic.c: Keeping N kernel threads runnable around blocking system calls
+ *
+ * Every kernel thread running the scheduler has an entry in a table. A kernel
+ * thread is runnable unless it is
+ *
+ *   parked     waiting on its futex in elastic_idle
+ *   in_region  between blocking_region_begin and blocking_region_end
+ *   stalled    seen asleep in the kernel by the monitor
+ *
+ * and balance() wakes parked kernel threads, or clones new ones, until
+ * num_kthreads are runnable. Kernel threads that have been cloned but have not
+ * registered yet count as runnable, so that balance() does not clone another
+ * one for the same shortfall. All of the counts are protected by pool_lock.
+ *
+ * Kernel threads are never destroyed: a surplus kernel thread parks instead,
+ * and is the first to be woken the next time one is needed.
+ */
+
+#define _GNU_SOURCE
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+
+#include "affinity.h"
+#include "elastic.h"
+#include "scheduler.h"
+
+#define MAX_KTHREADS        256
+#define KTHREAD_STACK_SIZE  (256 * 1024)
+
+#define CLONE_FLAGS (CLONE_THREAD | CLONE_VM | CLONE_SIGHAND | \
+                     CLONE_FILES | CLONE_FS | CLONE_IO)
+
+struct pool_entry {
+  volatile pid_t kernel_tid;
+  volatile int parked;           /* futex word */
+  volatile int in_region;
+  int stalled;                   /* protected by pool_lock */
+  int asleep_samples;            /* monitor only */
+  long long cpu_ns;              /* monitor only */
+};
+
+static int enabled;
+static int target;
+static int (*kthread_fn)(void *);
+
+static struct pool_entry pool[MAX_KTHREADS];
+static AO_TS_t pool_lock = AO_TS_INITIALIZER;
+
+/* protected by pool_lock */
+static int registered, starting, parked, in_region, stalled;
+
+static int runnable(void) {
+  return registered + starting - parked - in_region - stalled;
+}
+
+static struct pool_entry * my_entry(void) {
+  pid_t kernel_tid = syscall(SYS_gettid);
+  int i, n = registered;
+
+  for(i = 0; i < n; ++i) {
+    if(pool[i].kernel_tid == kernel_tid) {
+      return &pool[i];
+    }
+  }
+  return NULL;
+}
+
+static void futex_wait(volatile int * word, int value) {
+  syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0);
+}
+
+static void futex_wake(volatile int * word) {
+  syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+/* Make kernel threads runnable until there are target of them. Must hold
+ * pool_lock.
+ */
+static void balance(void) {
+  int i;
+
+  while(runnable() < target) {
+    if(parked > 0) {
+      for(i = 0; i < registered && !pool[i].parked; ++i) {
+      }
+      pool[i].parked = 0;
+      --parked;
+      futex_wake(&pool[i].parked);
+      continue;
+    }
+
+    if(registered + starting >= MAX_KTHREADS) {
+      return;
+    }
+
+    /* an id of its own, so it is not pinned to another kernel thread's CPU */
+    int id = kthread_reserve(1);
+    char * stack = node_alloc(KTHREAD_STACK_SIZE);
+    if(!stack || clone(kthread_fn, stack + KTHREAD_STACK_SIZE, CLONE_FLAGS,
+                       (void *)(long)id) < 0) {
+      perror("elastic: clone");
+      return;
+    }
+    ++starting;
+  }
+}
+
+/* CPU time a kernel thread has used, in nanoseconds. This is the clock
+ * pthread_getcpuclockid would return for it, and costs one system call,
+ * which is a lot cheaper than reading its state from /proc.
+ */
+static long long task_cpu_ns(pid_t kernel_tid) {
+  struct timespec ts;
+  clockid_t clock = ((~(clockid_t)kernel_tid) << 3) | 6;
+
+  if(clock_gettime(clock, &ts) < 0) {
+    return -1;
+  }
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* State of a kernel thread from /proc: 'R' running, 'S' or 'D' asleep, ... */
+static char task_state(pid_t kernel_tid) {
+  char path[64], buf[256];
+
+  snprintf(path, sizeof(path), "/proc/self/task/%d/stat", (int)kernel_tid);
+  int fd = open(path, O_RDONLY);
+  if(fd < 0) {
+    return '?';
+  }
+  ssize_t n = read(fd, buf, sizeof(buf) - 1);
+  close(fd);
+  if(n <= 0) {
+    return '?';
+  }
+  buf[n] = '\0';
+
+  /* the command name is in parentheses and may contain spaces */
+  char * p = strrchr(buf, ')');
+  return p && p[1] == ' ' ? p[2] : '?';
+}
+
+/* The monitor is a kernel thread of its own, which never runs user-level
+ * threads, so it must not touch current_thread. A kernel thread that was on
+ * a CPU for at least half of the last interval is busy, not blocked; only the
+ * others need their state read from /proc.
+ */
+static int monitor(void * arg) {
+  struct timespec interval = { 0, ELASTIC_INTERVAL_US * 1000 };
+  int i;
+
+  while(1) {
+    nanosleep(&interval, NULL);
+
+    int n = registered, now_stalled = 0;
+    for(i = 0; i < n; ++i) {
+      struct pool_entry * e = &pool[i];
+      long long cpu_ns = task_cpu_ns(e->kernel_tid);
+      char state = 'R';
+
+      if(!e->parked && !e->in_region &&
+         cpu_ns - e->cpu_ns < ELASTIC_INTERVAL_US * 1000 / 2) {
+        state = task_state(e->kernel_tid);
+      }
+      e->cpu_ns = cpu_ns;
+
+      e->asleep_samples = state == 'S' || state == 'D' ? e->asleep_samples + 1 : 0;
+    }
+
+    /* a kernel thread may have parked or entered a blocking region since it
+     * was sampled, and is already counted as not runnable for that */
+    spinlock_lock(&pool_lock);
+    for(i = 0; i < n; ++i) {
+      struct pool_entry * e = &pool[i];
+      e->stalled = !e->parked && !e->in_region &&
+                   e->asleep_samples >= ELASTIC_STALL_SAMPLES;
+      now_stalled += e->stalled;
+    }
+    stalled = now_stalled;
+    balance();
+    spinlock_unlock(&pool_lock);
+  }
+  return 0;
+}
+
+void elastic_init(int num_kthreads, int (*kthread_begin)(void *)) {
+#ifdef UNIPROCESSOR
+  /* there must only ever be one kernel thread */
+  enabled = 0;
+#else
+  const char * env = getenv("KTHREAD_ELASTIC");
+  enabled = !env || strcmp(env, "0");
+#endif
+  target = num_kthreads;
+  kthread_fn = kthread_begin;
+
+  if(!enabled) {
+    return;
+  }
+
+  starting = num_kthreads;
+  elastic_register();
+
+  char * stack = node_alloc(KTHREAD_STACK_SIZE);
+  if(!stack || clone(monitor, stack + KTHREAD_STACK_SIZE, CLONE_FLAGS, NULL) < 0) {
+    perror("elastic: monitor");
+  }
+}
+
+void elastic_register(void) {
+  if(!enabled) {
+    return;
+  }
+
+  spinlock_lock(&pool_lock);
+  if(registered < MAX_KTHREADS) {
+    pool[registered].kernel_tid = syscall(SYS_gettid);
+    ++registered;
+    --starting;
+  }
+  spinlock_unlock(&pool_lock);
+}
+
+void elastic_idle(void) {
+  if(!enabled) {
+    return;
+  }
+
+  struct pool_entry * e = my_entry();
+  if(!e) {
+    return;
+  }
+
+  spinlock_lock(&pool_lock);
+  if(runnable() <= target || e->stalled) {
+    spinlock_unlock(&pool_lock);
+    return;
+  }
+  e->parked = 1;
+  ++parked;
+  spinlock_unlock(&pool_lock);
+
+  while(e->parked) {
+    futex_wait(&e->parked, 1);
+  }
+}
+
+void blocking_region_begin(void) {
+  if(!enabled) {
+    return;
+  }
+
+  struct pool_entry * e = my_entry();
+  if(!e) {
+    return;
+  }
+
+  spinlock_lock(&pool_lock);
+  e->in_region = 1;
+  ++in_region;
+  if(e->stalled) {
+    e->stalled = 0;
+    --stalled;
+  }
+  balance();
+  spinlock_unlock(&pool_lock);
+}
+
+void blocking_region_end(void) {
+  if(!enabled) {
+    return;
+  }
+
+  struct pool_entry * e = my_entry();
+  if(!e) {
+    return;
+  }
+
+  spinlock_lock(&pool_lock);
+  e->in_region = 0;
+  --in_region;
+  spinlock_unlock(&pool_lock);
+}
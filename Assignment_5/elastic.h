@@ -0,0 +1,55 @@
+/* CS533 Assignment 5
+ * elastic.h: Keeping N kernel threads runnable around blocking system calls
+ *
+ * A user-level thread that makes a blocking system call without a wrapper
+ * (open, stat, scanf, getaddrinfo...) blocks the kernel thread it is running
+ * on, and every user-level thread waiting on the ready list has one fewer
+ * kernel thread to run on. This module keeps num_kthreads kernel threads
+ * runnable by waking or cloning spare kernel threads while others are blocked,
+ * and parks the surplus again once they are idle.
+ *
+ * Blocked kernel threads are found two ways:
+ *
+ *   - explicitly, by bracketing the call with blocking_region_begin() and
+ *     blocking_region_end(), which compensates immediately; and
+ *   - by a monitor kernel thread, which looks at the state of every kernel
+ *     thread in /proc every ELASTIC_INTERVAL_US and compensates for any that
+ *     have been asleep in the kernel for ELASTIC_STALL_SAMPLES samples in a
+ *     row.
+ *
+ * Setting the KTHREAD_ELASTIC environment variable to 0 turns all of this off.
+ *
+ * See the "Elastic Kernel Threads" section of README.md for where to call
+ * these from your scheduler.
+ */
+
+#ifndef ELASTIC_H
+#define ELASTIC_H
+
+#define ELASTIC_INTERVAL_US  1000
+#define ELASTIC_STALL_SAMPLES   2
+
+/* Keep num_kthreads kernel threads runnable. Spare kernel threads are
+ * created with clone(kthread_begin, ..., (void *)id), just like the ones
+ * scheduler_begin creates, with id from kthread_reserve(1) (see affinity.h).
+ * Call from scheduler_begin after it has reserved the ids of its own kernel
+ * threads with kthread_reserve(num_kthreads), but before creating any of
+ * them; this registers the calling kernel thread.
+ */
+void elastic_init(int num_kthreads, int (*kthread_begin)(void *));
+
+/* Call first thing in kthread_begin */
+void elastic_register(void);
+
+/* Call on every pass through an idle loop. If more than num_kthreads kernel
+ * threads are runnable, the calling one parks here until it is needed again.
+ */
+void elastic_idle(void);
+
+/* Bracket a system call that may block the kernel thread. Do not yield, or
+ * call anything that might, in between.
+ */
+void blocking_region_begin(void);
+void blocking_region_end(void);
+
+#endif
@@ -0,0 +1,151 @@
+/* CS533 Assignment 5
+ * hugepage.c: Huge page backing for large buffers and thread stacks
+ *
+ * A transparent huge page can only back a 2MiB-aligned 2MiB range, so large
+ * allocations are made aligned: map one huge page more than asked for, and
+ * unmap whatever sticks out on either side of the aligned range.
+ *
+ * Stacks come from STACK_CHUNK_SIZE chunks. With KTHREAD_HUGE_STACKS=1 the
+ * chunks are allocated with huge_alloc, so two 1MiB stacks share each huge
+ * page, but then every stack takes up all of its memory as soon as it is
+ * used, where with 4KiB pages it only takes up the pages it has touched.
+ * Freed stacks go on a free list, and since their pages stay mapped, a
+ * recycled stack does not fault again. The free list is protected by a
+ * spinlock, which is no worse than the safe_mem spinlock every malloc'd stack
+ * used to take.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "hugepage.h"
+#include "scheduler.h"
+
+#ifndef MAP_HUGETLB
+#define MAP_HUGETLB 0x40000
+#endif
+
+static volatile int policy = -1;
+static volatile int huge_stacks = -1;
+
+struct free_stack {
+  struct free_stack * next;
+};
+
+static AO_TS_t arena_lock = AO_TS_INITIALIZER;
+static struct free_stack * free_stacks;    /* protected by arena_lock */
+static char * chunk_next, * chunk_end;     /* protected by arena_lock */
+
+huge_policy_t huge_policy(void) {
+  if(policy < 0) {
+    const char * env = getenv("KTHREAD_HUGEPAGES");
+    if(!env || !strcmp(env, "none")) {
+      policy = HUGE_NONE;
+    } else if(!strcmp(env, "thp")) {
+      policy = HUGE_THP;
+    } else if(!strcmp(env, "hugetlb")) {
+      policy = HUGE_HUGETLB;
+    } else {
+      fprintf(stderr, "KTHREAD_HUGEPAGES: unknown policy \"%s\"\n", env);
+      policy = HUGE_NONE;
+    }
+  }
+  return policy;
+}
+
+void huge_set_policy(huge_policy_t p) {
+  policy = p;
+}
+
+static size_t round_up(size_t size) {
+  return (size + HUGE_PAGE_SIZE - 1) & ~(size_t)(HUGE_PAGE_SIZE - 1);
+}
+
+static void * map(size_t size, int flags) {
+  void * p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+  return p == MAP_FAILED ? NULL : p;
+}
+
+void * huge_alloc(size_t size) {
+  if(size < HUGE_PAGE_SIZE) {
+    return map(size, 0);
+  }
+
+  size = round_up(size);
+  if(huge_policy() == HUGE_HUGETLB) {
+    void * p = map(size, MAP_HUGETLB);
+    if(p) {
+      return p;
+    }
+  }
+
+  char * raw = map(size + HUGE_PAGE_SIZE, 0);
+  if(!raw) {
+    return NULL;
+  }
+
+  char * p = (char *)round_up((size_t)raw);
+  if(p > raw) {
+    munmap(raw, p - raw);
+  }
+  munmap(p + size, raw + HUGE_PAGE_SIZE - p);
+
+  /* with "always" in /sys/kernel/mm/transparent_hugepage/enabled, the
+   * kernel would use huge pages even for the none policy */
+  madvise(p, size, huge_policy() == HUGE_NONE ? MADV_NOHUGEPAGE : MADV_HUGEPAGE);
+  return p;
+}
+
+void huge_free(void * p, size_t size) {
+  munmap(p, size < HUGE_PAGE_SIZE ? size : round_up(size));
+}
+
+static char * stack_chunk(void) {
+  if(huge_stacks < 0) {
+    const char * env = getenv("KTHREAD_HUGE_STACKS");
+    huge_stacks = env && strcmp(env, "0");
+  }
+
+  if(huge_stacks) {
+    return huge_alloc(STACK_CHUNK_SIZE);
+  }
+
+  char * chunk = map(STACK_CHUNK_SIZE, 0);
+  if(chunk) {
+    madvise(chunk, STACK_CHUNK_SIZE, MADV_NOHUGEPAGE);
+  }
+  return chunk;
+}
+
+void * stack_alloc(size_t stack_size) {
+  void * stack = NULL;
+
+  spinlock_lock(&arena_lock);
+  if(free_stacks) {
+    stack = free_stacks;
+    free_stacks = free_stacks->next;
+  } else {
+    if(chunk_next == chunk_end) {
+      chunk_next = stack_chunk();
+      chunk_end = chunk_next ? chunk_next + STACK_CHUNK_SIZE : NULL;
+    }
+    if(chunk_next) {
+      stack = chunk_next;
+      chunk_next += stack_size;
+    }
+  }
+  spinlock_unlock(&arena_lock);
+  return stack;
+}
+
+void stack_free(void * stack) {
+  struct free_stack * s = stack;
+
+  spinlock_lock(&arena_lock);
+  s->next = free_stacks;
+  free_stacks = s;
+  spinlock_unlock(&arena_lock);
+}
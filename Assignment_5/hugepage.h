@@ -0,0 +1,64 @@
+/* CS533 Assignment 5
+ * hugepage.h: Huge page backing for large buffers and thread stacks
+ *
+ * With 4KiB pages, a merge() that streams through a few hundred megabytes
+ * misses in the TLB every 4KiB, and a switch to a thread whose stack has not
+ * run lately misses on its stack. A 2MiB page covers 512 times as much
+ * memory with one TLB entry.
+ *
+ * The policy comes from the KTHREAD_HUGEPAGES environment variable:
+ *
+ *   none      4KiB pages only; transparent huge pages are turned off for
+ *             these allocations (the default)
+ *   thp       transparent huge pages, with madvise(MADV_HUGEPAGE)
+ *   hugetlb   pages from the hugetlbfs pool, with MAP_HUGETLB, falling back
+ *             to thp when the pool is empty
+ *
+ * Thread stacks only use huge pages if KTHREAD_HUGE_STACKS is set to 1 as
+ * well: a stack on huge pages takes up all of its memory, not just the pages
+ * it has touched, which is too much for a program with many live threads.
+ *
+ * See the "Huge Pages" section of README.md for where to call these from
+ * your scheduler.
+ */
+
+#ifndef HUGEPAGE_H
+#define HUGEPAGE_H
+
+#include <stddef.h>
+
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+/* Stacks are carved out of chunks of this size */
+#define STACK_CHUNK_SIZE (16 * HUGE_PAGE_SIZE)
+
+typedef enum {
+  HUGE_NONE,
+  HUGE_THP,
+  HUGE_HUGETLB
+} huge_policy_t;
+
+/* The policy is read from KTHREAD_HUGEPAGES the first time it is needed;
+ * huge_set_policy overrides it.
+ */
+huge_policy_t huge_policy(void);
+void huge_set_policy(huge_policy_t policy);
+
+/* Allocate size bytes of fresh pages. Allocations of at least HUGE_PAGE_SIZE
+ * are rounded up to a whole number of huge pages and aligned to one, so pass
+ * huge_free the same size. Like node_alloc, nothing touches the pages here.
+ */
+void * huge_alloc(size_t size);
+void huge_free(void * p, size_t size);
+
+/* Below this, a buffer is better off coming from malloc than huge_alloc */
+#define HUGE_ALLOC_MIN (256 * 1024)
+
+/* Allocate and free thread stacks of stack_size bytes, which must divide
+ * STACK_CHUNK_SIZE and be the same on every call. Stacks are never returned
+ * to the system; a freed stack is handed out again by the next stack_alloc.
+ */
+void * stack_alloc(size_t stack_size);
+void stack_free(void * stack);
+
+#endif
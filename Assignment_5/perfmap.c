@@ -0,0 +1,123 @@
+/* CS533 Assignment 5
+ * perfmap.c: Telling perf which user-level thread a sample came from
+ *
+ * A stub is
+ *
+ *   push %rbp              so that frame pointer call chains go through it
+ *   mov  %rsp,%rbp
+ *   movabs $fn,%rax
+ *   call *%rax             arg is still in %rdi
+ *   pop  %rbp
+ *   ret
+ *
+ * copied into STUB_CHUNK_SIZE chunks of memory mapped readable, writable and
+ * executable, with fn patched in. Each gets a line in the perf map file,
+ * written with a single write() so that lines from different kernel threads
+ * never interleave; stdio is no good here, since its locks think every
+ * kernel thread is the same thread.
+ */
+
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "perfmap.h"
+#include "scheduler.h"
+
+#define STUB_CHUNK_SIZE (64 * 1024)
+#define STUB_FN_OFFSET  6
+
+static const unsigned char stub_code[] = {
+  0x55,                                          /* push %rbp */
+  0x48, 0x89, 0xe5,                              /* mov %rsp,%rbp */
+  0x48, 0xb8, 0, 0, 0, 0, 0, 0, 0, 0,            /* movabs $fn,%rax */
+  0xff, 0xd0,                                    /* call *%rax */
+  0x5d,                                          /* pop %rbp */
+  0xc3                                           /* ret */
+};
+
+static volatile int enabled = -1;
+static volatile AO_t next_id;
+static int map_fd = -1;
+
+static AO_TS_t chunk_lock = AO_TS_INITIALIZER;
+static char * chunk_next, * chunk_end;           /* protected by chunk_lock */
+
+int perfmap_enabled(void) {
+  if(enabled < 0) {
+    const char * env = getenv("KTHREAD_PERF_MAP");
+    int on = env && strcmp(env, "0");
+    if(on) {
+      char path[64];
+      snprintf(path, sizeof(path), "/tmp/perf-%d.map", (int)getpid());
+      map_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+      if(map_fd < 0) {
+        perror("perfmap: open");
+        on = 0;
+      }
+    }
+    enabled = on;
+  }
+  return enabled;
+}
+
+/* fn's symbol, or for a static function, its offset in the executable */
+static void format_function(char * buf, size_t len, void (*fn)(void *)) {
+  Dl_info info;
+
+  if(!dladdr((void *)fn, &info)) {
+    snprintf(buf, len, "%p", (void *)fn);
+  } else if(info.dli_sname) {
+    snprintf(buf, len, "%s", info.dli_sname);
+  } else {
+    const char * file = strrchr(info.dli_fname, '/');
+    snprintf(buf, len, "%s+%#lx", file ? file + 1 : info.dli_fname,
+             (unsigned long)((char *)fn - (char *)info.dli_fbase));
+  }
+}
+
+static char * new_stub(void (*fn)(void *)) {
+  spinlock_lock(&chunk_lock);
+  if(chunk_next == chunk_end) {
+    char * chunk = mmap(NULL, STUB_CHUNK_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(chunk == MAP_FAILED) {
+      spinlock_unlock(&chunk_lock);
+      perror("perfmap: mmap");
+      enabled = 0;
+      return NULL;
+    }
+    chunk_next = chunk;
+    chunk_end = chunk + STUB_CHUNK_SIZE;
+  }
+  char * stub = chunk_next;
+  chunk_next += PERFMAP_STUB_SIZE;
+  spinlock_unlock(&chunk_lock);
+
+  memcpy(stub, stub_code, sizeof(stub_code));
+  memcpy(stub + STUB_FN_OFFSET, &fn, sizeof(fn));
+
+  char name[64], line[128];
+  format_function(name, sizeof(name), fn);
+  int len = snprintf(line, sizeof(line), "%lx %zx green_thread_%lu %s\n",
+                     (unsigned long)stub, sizeof(stub_code),
+                     (unsigned long)AO_fetch_and_add1_full(&next_id), name);
+  if(write(map_fd, line, len) != len) {
+    perror("perfmap: write");
+  }
+  return stub;
+}
+
+void perfmap_run(void (*fn)(void *), void * arg) {
+  char * stub = perfmap_enabled() ? new_stub(fn) : NULL;
+  if(stub) {
+    ((void (*)(void *))stub)(arg);
+  } else {
+    fn(arg);
+  }
+}
@@ -0,0 +1,37 @@
+/* CS533 Assignment 5
+ * perfmap.h: Telling perf which user-level thread a sample came from
+ *
+ * perf knows kernel threads, not user-level threads, so all it can say about
+ * a sample is which function it was in. With KTHREAD_PERF_MAP=1,
+ * perfmap_run gives every thread an entry stub of its own, a few bytes of
+ * code that just calls the thread's initial function, and names it in
+ * /tmp/perf-<pid>.map, the file perf reads names for generated code from:
+ *
+ *   green_thread_<id> <initial function>
+ *
+ * Every call chain the thread records then ends in its own stub, so
+ * perf report --children (or --sort sym with call graphs) shows how much
+ * time each user-level thread spent. Without the variable set, perfmap_run
+ * just calls the function.
+ *
+ * Stubs are never freed, since perf may still need their names after the
+ * thread is gone, so this is for profiling runs only.
+ *
+ * See the "Profiling User-Level Threads" section of README.md.
+ */
+
+#ifndef PERFMAP_H
+#define PERFMAP_H
+
+/* Bytes of code per stub */
+#define PERFMAP_STUB_SIZE 32
+
+/* Whether KTHREAD_PERF_MAP is set to 1; read the first time it is needed */
+int perfmap_enabled(void);
+
+/* Call fn(arg) from a new stub named for a new thread ID. Call it from
+ * thread_wrap in place of calling initial_function directly.
+ */
+void perfmap_run(void (*fn)(void *), void * arg);
+
+#endif
@@ -0,0 +1,293 @@
+/* CS533 Assignment 5
+ * primes.c: Counting and finding primes with a parallel segmented sieve
+ *
+ * Byte k of a task stands for the 30 numbers from lo + 30k, where lo is the
+ * start of the task, a multiple of 30. Bit i stands for lo + 30k + wheel[i];
+ * the other 22 are multiples of 2, 3 or 5. 2, 3 and 5 themselves are
+ * counted separately.
+ *
+ * The multiples of a sieving prime p that have bits are p * m with m
+ * coprime to 30. Those with m = wheel[j] (mod 30) come every 30p numbers,
+ * which is every p bytes, and always use the same bit. So a worker keeps 8
+ * offsets per sieving prime, the next byte of the task to cross off in each
+ * of the 8 classes, and crossing off is a loop that clears one bit every p
+ * bytes until it runs off the end of the segment. Crossing off starts at
+ * p * p, and primes are sorted, so a segment stops at the first prime whose
+ * square is past its end.
+ *
+ * An offset is a byte of the task, so for a prime whose square is past the
+ * end of a task it can be larger than fits in 32 bits; it is clamped to
+ * UINT32_MAX, which is never reached.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "primes.h"
+#include "scheduler.h"
+
+#define TASK_SPAN (30L * PRIMES_SEGMENT_BYTES * PRIMES_TASK_SEGMENTS)
+
+static const int wheel[8] = { 1, 7, 11, 13, 17, 19, 23, 29 };
+
+/* wheel[wheel_bit[r]] == r, or -1 for r not coprime to 30 */
+static const signed char wheel_bit[30] = {
+  -1,  0, -1, -1, -1, -1, -1,  1, -1, -1, -1,  2, -1,  3, -1,
+  -1, -1,  4, -1,  5, -1, -1, -1,  6, -1, -1, -1, -1, -1,  7
+};
+
+struct sieve {
+  long limit;                    /* sieve the numbers below limit */
+  int * primes;                  /* 7 <= p with p * p < limit, in order */
+  int num_primes;
+  long num_tasks;
+  long * counts;                 /* primes in each task, from 7 up */
+  volatile AO_t next_task;
+};
+
+struct worker {
+  unsigned char * seg;
+  uint32_t * offsets;            /* 8 per sieving prime */
+};
+
+/* The primes from 7 up whose squares are below limit, by a plain sieve */
+static void find_sieving_primes(struct sieve * s) {
+  long r = (long)sqrt((double)s->limit), i, j;
+  while(r > 0 && r * r >= s->limit) {
+    --r;
+  }
+  while((r + 1) * (r + 1) < s->limit) {
+    ++r;
+  }
+
+  char * composite = calloc(r + 1, 1);
+  s->primes = malloc(sizeof(int) * (r / 2 + 1));
+  s->num_primes = 0;
+  for(i = 2; i <= r; ++i) {
+    if(composite[i]) {
+      continue;
+    }
+    if(i >= 7) {
+      s->primes[s->num_primes++] = i;
+    }
+    for(j = i * i; j <= r; j += i) {
+      composite[j] = 1;
+    }
+  }
+  free(composite);
+}
+
+static void worker_init(struct sieve * s, struct worker * w) {
+  w->seg = malloc(PRIMES_SEGMENT_BYTES);
+  w->offsets = malloc(sizeof(uint32_t) * 8 * (s->num_primes + 1));
+}
+
+static void worker_free(struct worker * w) {
+  free(w->seg);
+  free(w->offsets);
+}
+
+/* Offsets of the first multiples at or after lo, and at or after p * p */
+static void init_offsets(struct sieve * s, uint32_t * offsets, long lo) {
+  int i, j;
+  for(i = 0; i < s->num_primes; ++i) {
+    long p = s->primes[i];
+    long m0 = (lo + p - 1) / p;
+    if(m0 < p) {
+      m0 = p;
+    }
+    for(j = 0; j < 8; ++j) {
+      long m = m0 + ((wheel[j] - m0 % 30) % 30 + 30) % 30;
+      long byte = (p * m - lo) / 30;
+      offsets[8 * i + j] = byte > UINT32_MAX ? UINT32_MAX : (uint32_t)byte;
+    }
+  }
+}
+
+/* Sieve bytes [base, base + bytes) of the task starting at lo into w->seg,
+ * leaving bits set only for primes below hi. The segment is padded with
+ * zeros to a whole number of 8-byte words.
+ */
+static void sieve_segment(struct sieve * s, struct worker * w, long lo,
+                          uint32_t base, int bytes, long hi) {
+  unsigned char * seg = w->seg;
+  long seg_lo = lo + 30L * base, seg_hi = seg_lo + 30L * bytes;
+  int i, j;
+
+  memset(seg, 0xff, bytes);
+  memset(seg + bytes, 0, -bytes & 7);
+
+  for(i = 0; i < s->num_primes; ++i) {
+    long p = s->primes[i];
+    if(p * p >= seg_hi) {
+      break;
+    }
+    uint32_t * offsets = w->offsets + 8 * i;
+    for(j = 0; j < 8; ++j) {
+      uint32_t k = offsets[j];
+      if(k >= base + bytes) {
+        continue;
+      }
+      unsigned char mask = ~(1 << wheel_bit[p * wheel[j] % 30]);
+      for(k -= base; k < (uint32_t)bytes; k += p) {
+        seg[k] &= mask;
+      }
+      offsets[j] = base + k;
+    }
+  }
+
+  if(seg_lo == 0) {
+    seg[0] &= ~1;                /* 1 is not a prime */
+  }
+  for(j = 0; j < 8; ++j) {
+    if(seg_hi - 30 + wheel[j] >= hi) {
+      seg[bytes - 1] &= ~(1 << j);
+    }
+  }
+}
+
+static int popcount64(uint64_t x) {
+  x = x - ((x >> 1) & 0x5555555555555555ULL);
+  x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+  x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+  return (int)((x * 0x0101010101010101ULL) >> 56);
+}
+
+static long count_bits(const unsigned char * seg, int bytes) {
+  const uint64_t * words = (const uint64_t *)seg;
+  long count = 0;
+  int i;
+  for(i = 0; i < (bytes + 7) / 8; ++i) {
+    count += popcount64(words[i]);
+  }
+  return count;
+}
+
+/* The number whose bit is the nth set bit of the segment starting at lo */
+static long find_bit(const unsigned char * seg, long lo, long nth) {
+  long k;
+  int j;
+  for(k = 0; ; ++k) {
+    for(j = 0; j < 8; ++j) {
+      if((seg[k] >> j & 1) && --nth == 0) {
+        return lo + 30 * k + wheel[j];
+      }
+    }
+  }
+}
+
+/* Sieve task t. With nth > 0, return its nth prime, or 0 if it has fewer;
+ * otherwise return how many primes it has.
+ */
+static long sieve_task(struct sieve * s, struct worker * w, long t, long nth) {
+  long lo = t * TASK_SPAN, hi = lo + TASK_SPAN, count = 0;
+  uint32_t base;
+
+  if(hi > s->limit) {
+    hi = s->limit;
+  }
+  init_offsets(s, w->offsets, lo);
+
+  for(base = 0; lo + 30L * base < hi; base += PRIMES_SEGMENT_BYTES) {
+    long seg_lo = lo + 30L * base;
+    long left = (hi - seg_lo + 29) / 30;
+    int bytes = left < PRIMES_SEGMENT_BYTES ? left : PRIMES_SEGMENT_BYTES;
+
+    sieve_segment(s, w, lo, base, bytes, hi);
+    long c = count_bits(w->seg, bytes);
+    if(nth > 0 && count + c >= nth) {
+      return find_bit(w->seg, seg_lo, nth - count);
+    }
+    count += c;
+    yield();
+  }
+  return nth > 0 ? 0 : count;
+}
+
+static void sieve_worker(void * arg) {
+  struct sieve * s = arg;
+  struct worker w;
+  long t;
+
+  worker_init(s, &w);
+  while((t = (long)AO_fetch_and_add1_full(&s->next_task)) < s->num_tasks) {
+    s->counts[t] = sieve_task(s, &w, t, 0);
+  }
+  worker_free(&w);
+}
+
+/* Count the primes from 7 up below limit, task by task, into s->counts */
+static void sieve_init(struct sieve * s, long limit) {
+  int n, i;
+
+  s->limit = limit;
+  s->num_tasks = (limit + TASK_SPAN - 1) / TASK_SPAN;
+  s->counts = malloc(sizeof(long) * s->num_tasks);
+  s->next_task = 0;
+  find_sieving_primes(s);
+
+  n = s->num_tasks < PRIMES_WORKERS ? s->num_tasks : PRIMES_WORKERS;
+  if(n == 1) {
+    sieve_worker(s);
+  } else {
+    struct thread * threads[PRIMES_WORKERS];
+    for(i = 0; i < n; ++i) {
+      threads[i] = thread_fork(sieve_worker, s);
+    }
+    for(i = 0; i < n; ++i) {
+      thread_join(threads[i]);
+    }
+  }
+}
+
+static void sieve_free(struct sieve * s) {
+  free(s->primes);
+  free(s->counts);
+}
+
+long primes_count(long n) {
+  struct sieve s;
+  long count, t;
+
+  if(n < 7) {
+    return (n >= 2) + (n >= 3) + (n >= 5);
+  }
+
+  sieve_init(&s, n + 1);
+  for(count = 3, t = 0; t < s.num_tasks; ++t) {
+    count += s.counts[t];
+  }
+  sieve_free(&s);
+  return count;
+}
+
+long primes_nth(long n) {
+  static const long first[3] = { 2, 3, 5 };
+  struct sieve s;
+  struct worker w;
+  long t, p;
+
+  if(n < 1) {
+    return 0;
+  }
+  if(n <= 3) {
+    return first[n - 1];
+  }
+
+  /* p_n < n (ln n + ln ln n) for n >= 6 (Rosser) */
+  double x = n < 6 ? 6 : n;
+  sieve_init(&s, (long)(x * (log(x) + log(log(x)))) + 1);
+
+  n -= 3;
+  for(t = 0; s.counts[t] < n; ++t) {
+    n -= s.counts[t];
+  }
+  worker_init(&s, &w);
+  p = sieve_task(&s, &w, t, n);
+  worker_free(&w);
+
+  sieve_free(&s);
+  return p;
+}
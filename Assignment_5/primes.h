@@ -0,0 +1,32 @@
+/* CS533 Assignment 5
+ * primes.h: Counting and finding primes with a parallel segmented sieve
+ *
+ * The numbers to sieve are split into tasks of PRIMES_TASK_SEGMENTS
+ * segments, and up to PRIMES_WORKERS user-level threads take tasks until
+ * there are none left, so the work spreads over every kernel thread. A
+ * segment covers 30 * PRIMES_SEGMENT_BYTES numbers: with a mod-30 wheel,
+ * only the 8 numbers in every 30 that are not multiples of 2, 3 or 5 get a
+ * bit, so a segment that fits in the L1 cache covers 30 numbers per byte.
+ * Workers yield after every segment.
+ *
+ * Call these from a user-level thread, after scheduler_begin. The sieve
+ * keeps the primes up to the square root of its limit in memory, and each
+ * worker keeps 32 bytes for each of them.
+ *
+ * See the "Prime Sieve" section of README.md.
+ */
+
+#ifndef PRIMES_H
+#define PRIMES_H
+
+#define PRIMES_SEGMENT_BYTES  (32 * 1024)
+#define PRIMES_TASK_SEGMENTS  16
+#define PRIMES_WORKERS        64
+
+/* The number of primes <= n */
+long primes_count(long n);
+
+/* The nth prime, counting 2 as the first; 0 if n < 1 */
+long primes_nth(long n);
+
+#endif
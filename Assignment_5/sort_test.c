@@ -1,7 +1,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <time.h>
+#include "datagen.h"
+#include "hugepage.h"
 #include "scheduler.h"
 
 static int seq_threshold;
@@ -39,7 +40,8 @@ void merge(struct array * A, struct array * B) {
   int * arr2 = B->arr;
   int l2     = B->len;
 
-  int * result = malloc(sizeof(int) * (l1 + l2));
+  size_t bytes = sizeof(int) * (l1 + l2);
+  int * result = bytes >= HUGE_ALLOC_MIN ? huge_alloc(bytes) : malloc(bytes);
 
   int i = 0, j = 0, k = 0;
 
@@ -58,9 +60,13 @@ void merge(struct array * A, struct array * B) {
     memcpy(result+k, arr1+i, sizeof(int) * (l1-i));
   }
 
-  memcpy(arr1, result, sizeof(int) * (l1+l2));
+  memcpy(arr1, result, bytes);
 
-  free(result);
+  if(bytes >= HUGE_ALLOC_MIN) {
+    huge_free(result, bytes);
+  } else {
+    free(result);
+  }
 }
 
 
@@ -94,16 +100,13 @@ void par_mergesort(void * arg) {
   }
 }
 
-struct array * rand_array(int size) {
+/* Call it after scheduler_begin, so that the array is filled in parallel */
+struct array * make_array(int size, dist_t dist, unsigned long seed) {
   struct array * result = malloc(sizeof(struct array));
-  result->arr = malloc(sizeof(int) * size);
+  result->arr = huge_alloc(sizeof(int) * size);
   result->len = size;
 
-  int i;
-  srand(time(NULL));
-  for(i = 0; i < size; ++i) {
-    result->arr[i] = rand() % size;
-  }
+  datagen_fill(result->arr, size, dist, seed);
   return result;
 }
 
@@ -120,7 +123,8 @@ const char* check_sort(struct array * A) {
 
 int main(int argc, char ** argv) {
   if (argc < 4) {
-    fprintf(stderr, "usage: %s num_kthreads array_size seq_threshold\n", argv[0]);
+    fprintf(stderr, "usage: %s num_kthreads array_size seq_threshold "
+                    "[distribution [seed]]\n", argv[0]);
     exit(1);
   }
 
@@ -128,10 +132,21 @@ int main(int argc, char ** argv) {
   int array_size   = atoi(argv[2]);
   seq_threshold    = atoi(argv[3]);
 
-  struct array * A = rand_array(array_size);
+  int dist = argc > 4 ? dist_parse(argv[4]) : DIST_RANDOM;
+  unsigned long seed = argc > 5 ? strtoul(argv[5], NULL, 0) : 1;
+  if(dist < 0) {
+    fprintf(stderr, "%s: unknown distribution \"%s\"; one of", argv[0], argv[4]);
+    for(dist = 0; dist < NUM_DISTS; ++dist) {
+      fprintf(stderr, " %s", dist_name(dist));
+    }
+    fprintf(stderr, "\n");
+    exit(1);
+  }
 
   scheduler_begin(num_kthreads);
 
+  struct array * A = make_array(array_size, dist, seed);
+
   printf("before sort: %s\n", check_sort(A));
   par_mergesort(A);
   printf("after sort: %s\n", check_sort(A));
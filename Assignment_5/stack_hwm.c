@@ -0,0 +1,266 @@
+/* CS533 Assignment 5
+ * stack_hwm.c: Measuring how much of its stack each thread uses
+ *
+ * The canary is zero. Painting a whole 1MiB stack by hand would make every
+ * page of it resident, and a program with tens of thousands of live threads
+ * would run out of memory; madvise(MADV_DONTNEED) paints it for free instead,
+ * since the pages it drops read back as zero and take no memory until they
+ * are written. Only the ends of a stack that does not start and end on a
+ * page boundary, or a whole stack madvise refuses (such as one on hugetlbfs
+ * pages), are cleared by hand.
+ *
+ * Stacks grow down, so a thread's deepest point is the lowest nonzero word of
+ * its stack. mincore finds the lowest page the thread has touched without
+ * reading the ones below it, and the scan goes up from there. A frame whose
+ * lowest words the thread only ever set to zero, or never wrote at all, is
+ * missed, which is one reason for STACK_HWM_HEADROOM.
+ *
+ * Marks are counted in power-of-two buckets, from 1KiB up, in a table of
+ * STACK_HWM_MAX_FUNCTIONS entries keyed by initial_function. An entry is
+ * claimed with a compare-and-swap on its key, and everything in it is
+ * updated atomically, so threads finishing on different kernel threads never
+ * take a lock.
+ */
+
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "stack_hwm.h"
+#include "scheduler.h"
+
+#define MINCORE_BATCH 64                   /* pages per mincore call */
+#define MIN_SHIFT   10                     /* first bucket is up to 1KiB */
+#define NUM_BUCKETS 16                     /* last is everything over 16MiB */
+
+struct function_marks {
+  volatile AO_t fn;                        /* 0 while the entry is free */
+  volatile AO_t threads;
+  volatile AO_t deepest;
+  volatile AO_t overflows;                 /* stack used to the very end */
+  volatile AO_t buckets[NUM_BUCKETS];
+};
+
+static volatile int enabled = -1;
+static struct function_marks functions[STACK_HWM_MAX_FUNCTIONS];
+static volatile AO_t untracked;            /* threads with no entry */
+static volatile AO_t untracked_deepest;
+
+int stack_hwm_enabled(void) {
+  if(enabled < 0) {
+    const char * env = getenv("KTHREAD_STACK_HWM");
+    enabled = env && strcmp(env, "0");
+  }
+  return enabled;
+}
+
+static char * page_up(const void * p) {
+  size_t page = sysconf(_SC_PAGESIZE);
+  return (char *)(((size_t)p + page - 1) & ~(page - 1));
+}
+
+static char * page_down(const void * p) {
+  size_t page = sysconf(_SC_PAGESIZE);
+  return (char *)((size_t)p & ~(page - 1));
+}
+
+void stack_hwm_paint(void * stack, size_t stack_size) {
+  if(!stack_hwm_enabled()) {
+    return;
+  }
+
+  char * bottom = stack, * top = bottom + stack_size;
+  char * lo = page_up(bottom), * hi = page_down(top);
+  if(hi <= lo || madvise(lo, hi - lo, MADV_DONTNEED)) {
+    memset(stack, 0, stack_size);
+    return;
+  }
+  memset(bottom, 0, lo - bottom);
+  memset(hi, 0, top - hi);
+}
+
+/* The lowest nonzero word in [from, to), or NULL */
+static const char * first_nonzero(const char * from, const char * to) {
+  const uint64_t * w = (const uint64_t *)from, * end = (const uint64_t *)to;
+  while(w < end && !*w) {
+    ++w;
+  }
+  return w < end ? (const char *)w : NULL;
+}
+
+/* The lowest resident page in [lo, hi), both page aligned, or hi */
+static const char * first_touched(const char * lo, const char * hi) {
+  size_t page = sysconf(_SC_PAGESIZE);
+  unsigned char vec[MINCORE_BATCH];
+
+  while(lo < hi) {
+    size_t pages = (hi - lo) / page, i;
+    if(pages > MINCORE_BATCH) {
+      pages = MINCORE_BATCH;
+    }
+    if(mincore((void *)lo, pages * page, vec)) {
+      return lo;                           /* scan it all instead */
+    }
+    for(i = 0; i < pages; ++i) {
+      if(vec[i] & 1) {
+        return lo + i * page;
+      }
+    }
+    lo += pages * page;
+  }
+  return hi;
+}
+
+static void raise_to(volatile AO_t * max, AO_t value) {
+  AO_t old;
+  do {
+    old = AO_load(max);
+  } while(value > old && !AO_compare_and_swap_full(max, old, value));
+}
+
+/* The entry for fn, claimed if it has none yet, or NULL if the table is
+ * full */
+static struct function_marks * entry_for(AO_t fn) {
+  unsigned start = (fn >> 4) % STACK_HWM_MAX_FUNCTIONS, i = start;
+
+  do {
+    if(!AO_load_acquire(&functions[i].fn)) {
+      AO_compare_and_swap_full(&functions[i].fn, 0, fn);
+    }
+    /* claimed by now, by us or by someone else, maybe for another */
+    if(AO_load_acquire(&functions[i].fn) == fn) {
+      return &functions[i];
+    }
+    i = (i + 1) % STACK_HWM_MAX_FUNCTIONS;
+  } while(i != start);
+  return NULL;
+}
+
+void stack_hwm_measure(void (*fn)(void *), void * stack, size_t stack_size) {
+  if(!stack_hwm_enabled()) {
+    return;
+  }
+
+  const char * bottom = stack, * top = bottom + stack_size;
+  const char * lo = page_up(bottom), * hi = page_down(top), * deepest;
+  if(hi <= lo) {
+    deepest = first_nonzero(bottom, top);
+  } else if(!(deepest = first_nonzero(bottom, lo))) {
+    deepest = first_nonzero(first_touched(lo, hi), top);
+  }
+  size_t used = deepest ? top - deepest : 0;
+
+  struct function_marks * f = entry_for((AO_t)fn);
+  if(!f) {
+    AO_fetch_and_add1_full(&untracked);
+    raise_to(&untracked_deepest, used);
+    return;
+  }
+
+  int b = 0;
+  while(b < NUM_BUCKETS - 1 && used > (size_t)1 << (MIN_SHIFT + b)) {
+    ++b;
+  }
+  AO_fetch_and_add1_full(&f->buckets[b]);
+  AO_fetch_and_add1_full(&f->threads);
+  raise_to(&f->deepest, used);
+  if(used == stack_size) {
+    AO_fetch_and_add1_full(&f->overflows);
+  }
+}
+
+static void format_size(char * buf, size_t len, size_t size) {
+  if(size >= 1024 * 1024 && size % (1024 * 1024) == 0) {
+    snprintf(buf, len, "%zuM", size / (1024 * 1024));
+  } else if(size >= 1024 && size % 1024 == 0) {
+    snprintf(buf, len, "%zuK", size / 1024);
+  } else {
+    snprintf(buf, len, "%zu", size);
+  }
+}
+
+/* A static function has no dynamic symbol, so it is named by its offset in
+ * the executable instead; addr2line -f -e <executable> <offset> finds it.
+ */
+static void format_function(char * buf, size_t len, AO_t fn) {
+  Dl_info info;
+
+  if(!dladdr((void *)fn, &info)) {
+    snprintf(buf, len, "%#lx", (unsigned long)fn);
+  } else if(info.dli_sname) {
+    snprintf(buf, len, "%s", info.dli_sname);
+  } else {
+    const char * file = strrchr(info.dli_fname, '/');
+    snprintf(buf, len, "%s+%#lx", file ? file + 1 : info.dli_fname,
+             (unsigned long)(fn - (AO_t)info.dli_fbase));
+  }
+}
+
+void stack_hwm_report(size_t stack_size) {
+  if(!stack_hwm_enabled()) {
+    return;
+  }
+
+  size_t deepest = AO_load(&untracked_deepest);
+  AO_t threads = AO_load(&untracked), overflows = 0;
+  char name[64], size[24];
+  int i, b;
+
+  for(i = 0; i < STACK_HWM_MAX_FUNCTIONS; ++i) {
+    threads += AO_load(&functions[i].threads);
+  }
+  if(!threads) {
+    return;
+  }
+
+  format_size(size, sizeof(size), stack_size);
+  fprintf(stderr, "stack high-water marks (STACK_SIZE %s):\n", size);
+  for(i = 0; i < STACK_HWM_MAX_FUNCTIONS; ++i) {
+    struct function_marks * f = &functions[i];
+    if(!AO_load(&f->threads)) {
+      continue;
+    }
+
+    format_function(name, sizeof(name), AO_load(&f->fn));
+    fprintf(stderr, "  %-32s %10lu threads, deepest %zu bytes\n   ", name,
+            (unsigned long)AO_load(&f->threads), (size_t)AO_load(&f->deepest));
+    for(b = 0; b < NUM_BUCKETS; ++b) {
+      if(AO_load(&f->buckets[b])) {
+        int last = b == NUM_BUCKETS - 1;
+        format_size(size, sizeof(size), (size_t)1 << (MIN_SHIFT + b - last));
+        fprintf(stderr, " %s%s:%lu", last ? ">" : "<=", size,
+                (unsigned long)AO_load(&f->buckets[b]));
+      }
+    }
+    fprintf(stderr, "\n");
+
+    if(AO_load(&f->deepest) > deepest) {
+      deepest = AO_load(&f->deepest);
+    }
+    overflows += AO_load(&f->overflows);
+  }
+  if(AO_load(&untracked)) {
+    fprintf(stderr, "  %-32s %10lu threads, deepest %zu bytes\n", "(other functions)",
+            (unsigned long)AO_load(&untracked), (size_t)AO_load(&untracked_deepest));
+  }
+
+  if(overflows) {
+    fprintf(stderr, "%lu threads used all of their stack; STACK_SIZE is too small\n",
+            (unsigned long)overflows);
+    return;
+  }
+
+  /* stack_alloc needs a power of two */
+  size_t recommended = 4096;
+  while(recommended < deepest + STACK_HWM_HEADROOM) {
+    recommended <<= 1;
+  }
+  format_size(size, sizeof(size), recommended);
+  fprintf(stderr, "recommended STACK_SIZE: %s (deepest %zu bytes + %d headroom)\n",
+          size, deepest, STACK_HWM_HEADROOM);
+}
@@ -0,0 +1,51 @@
+/* CS533 Assignment 5
+ * stack_hwm.h: Measuring how much of its stack each thread uses
+ *
+ * Every thread gets STACK_SIZE bytes of stack, though most of them use a few
+ * kilobytes. To find out how many, set KTHREAD_STACK_HWM=1: thread_fork then
+ * paints each new stack with a canary, and when the thread finishes, the
+ * high-water mark is how far down from the top the canary has been
+ * overwritten. The marks are kept as a histogram per initial_function, and
+ * scheduler_end prints them along with a recommended STACK_SIZE.
+ *
+ * Painting and measuring each cost a system call or two per thread, and a
+ * thread's old stack is given back to the system when it is painted, so a
+ * recycled stack faults again. Leave it off except to measure.
+ *
+ * See the "Stack High-Water Marks" section of README.md for where to call
+ * these from your scheduler.
+ */
+
+#ifndef STACK_HWM_H
+#define STACK_HWM_H
+
+#include <stddef.h>
+
+/* Most distinct initial_functions that get histograms of their own; threads
+ * of any more are only counted in the total */
+#define STACK_HWM_MAX_FUNCTIONS 64
+
+/* Added to the deepest mark seen before rounding up to a recommended size,
+ * for signal handlers and for deeper paths that did not happen to run */
+#define STACK_HWM_HEADROOM (16 * 1024)
+
+/* Whether KTHREAD_STACK_HWM is set to 1; read the first time it is needed */
+int stack_hwm_enabled(void);
+
+/* Fill stack_size bytes at stack with the canary. Call it on every new stack,
+ * before anything is pushed on it. Does nothing unless enabled.
+ */
+void stack_hwm_paint(void * stack, size_t stack_size);
+
+/* Measure the high-water mark of a finished thread's stack and count it
+ * against fn. Call it before the stack is freed or reused. Does nothing
+ * unless enabled.
+ */
+void stack_hwm_measure(void (*fn)(void *), void * stack, size_t stack_size);
+
+/* Print the histograms and the recommended stack size to stderr. Does
+ * nothing unless enabled, or if no thread has finished.
+ */
+void stack_hwm_report(size_t stack_size);
+
+#endif
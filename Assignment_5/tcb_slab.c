@@ -0,0 +1,168 @@
+/* CS533 Assignment 5
+ * tcb_slab.c: Per-kernel-thread slabs for thread control blocks
+ *
+ * Each block in a slab is laid out as
+ *
+ *   | TCB (sizeof(struct thread)) | struct tcb_header | padding |
+ *   ^ cache line aligned                                        ^ next line
+ *
+ * so the TCB pointer handed out is the start of the block, and the header is
+ * found at a fixed offset from it.
+ *
+ * A kernel thread finds its own slab by looking its kernel thread ID up in a
+ * table, the same way threadmap.c finds the current thread. Only the owner
+ * ever takes TCBs off its slab's free lists:
+ *
+ *   free     TCBs freed by the owner; touched by the owner only
+ *   remote   TCBs freed by other kernel threads; a lock-free stack that
+ *            anyone pushes onto and the owner empties all at once, so there
+ *            is no ABA problem
+ *
+ * Slab memory comes from node_alloc, so it is first touched by the kernel
+ * thread that owns it (see affinity.h), and it is never returned to the
+ * system; kernel threads live until the program exits anyway.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <atomic_ops.h>
+
+#include "affinity.h"
+#include "tcb_slab.h"
+
+#define CHUNK_SIZE (64 * 1024)
+#define MAX_SLABS  256           /* power of 2, at least 2x the kthreads */
+
+struct tcb_slab;
+
+struct tcb_header {
+  struct tcb_slab * owner;
+  volatile AO_t refs;
+  struct tcb_header * next;      /* on free or remote */
+};
+
+struct tcb_slab {
+  struct tcb_header * free;
+  char pad[TCB_CACHE_LINE - sizeof(struct tcb_header *)];
+  volatile AO_t remote;
+};
+
+struct slab_entry {
+  volatile AO_t kernel_tid;
+  struct tcb_slab * slab;
+};
+
+static struct slab_entry slabs[MAX_SLABS];
+
+static size_t header_offset;     /* from the start of a block */
+static size_t block_size;
+
+void tcb_init(size_t tcb_size) {
+  header_offset = (tcb_size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+  block_size = header_offset + sizeof(struct tcb_header);
+  block_size = (block_size + TCB_CACHE_LINE - 1) & ~(size_t)(TCB_CACHE_LINE - 1);
+}
+
+static struct tcb_header * header_of(void * tcb) {
+  return (struct tcb_header *)((char *)tcb + header_offset);
+}
+
+static void * tcb_of(struct tcb_header * h) {
+  return (char *)h - header_offset;
+}
+
+/* The calling kernel thread's slab, created on first use. Each kernel thread
+ * only ever reads or writes its own entry, so once an entry's kernel_tid is
+ * claimed there is nothing left to race on.
+ */
+static struct tcb_slab * my_slab(void) {
+  pid_t kernel_tid = syscall(SYS_gettid);
+  unsigned i = kernel_tid & (MAX_SLABS - 1), probes;
+
+  for(probes = 0; probes < MAX_SLABS; ++probes, i = (i + 1) & (MAX_SLABS - 1)) {
+    AO_t owner = AO_load(&slabs[i].kernel_tid);
+    if(owner == (AO_t)kernel_tid) {
+      return slabs[i].slab;
+    }
+    if(owner == 0 && AO_compare_and_swap(&slabs[i].kernel_tid, 0, kernel_tid)) {
+      struct tcb_slab * s = node_alloc(sizeof(struct tcb_slab));
+      if(!s) {
+        perror("tcb_slab: node_alloc");
+        abort();
+      }
+      s->free = NULL;
+      s->remote = 0;
+      slabs[i].slab = s;
+      return s;
+    }
+  }
+
+  fprintf(stderr, "tcb_slab: more than %d kernel threads\n", MAX_SLABS);
+  abort();
+}
+
+/* Carve a fresh chunk into blocks on s's free list */
+static void grow(struct tcb_slab * s) {
+  char * chunk = node_alloc(CHUNK_SIZE);
+  size_t off;
+
+  if(!chunk) {
+    perror("tcb_slab: node_alloc");
+    abort();
+  }
+
+  for(off = 0; off + block_size <= CHUNK_SIZE; off += block_size) {
+    struct tcb_header * h = header_of(chunk + off);
+    h->owner = s;
+    h->next = s->free;
+    s->free = h;
+  }
+}
+
+void * tcb_alloc(void) {
+  struct tcb_slab * s = my_slab();
+
+  if(!s->free) {
+    /* take everything the other kernel threads have handed back */
+    AO_t remote;
+    do {
+      remote = AO_load(&s->remote);
+    } while(remote && !AO_compare_and_swap_full(&s->remote, remote, 0));
+    s->free = (struct tcb_header *)remote;
+  }
+  if(!s->free) {
+    grow(s);
+  }
+
+  struct tcb_header * h = s->free;
+  s->free = h->next;
+  AO_store(&h->refs, 2);
+  return tcb_of(h);
+}
+
+void tcb_release(void * tcb) {
+  if(AO_fetch_and_sub1_full(&header_of(tcb)->refs) == 1) {
+    tcb_free(tcb);
+  }
+}
+
+void tcb_free(void * tcb) {
+  struct tcb_header * h = header_of(tcb);
+  struct tcb_slab * s = h->owner;
+
+  if(s == my_slab()) {
+    h->next = s->free;
+    s->free = h;
+    return;
+  }
+
+  AO_t old;
+  do {
+    old = AO_load(&s->remote);
+    h->next = (struct tcb_header *)old;
+  } while(!AO_compare_and_swap_full(&s->remote, old, (AO_t)h));
+}
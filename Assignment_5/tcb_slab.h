@@ -0,0 +1,48 @@
+/* CS533 Assignment 5
+ * tcb_slab.h: Per-kernel-thread slabs for thread control blocks
+ *
+ * thread_fork allocates a struct thread and the thread leaves it behind when
+ * it finishes. With malloc, every one of those goes through safe_mem's single
+ * spinlock. Here each kernel thread carves TCBs out of its own slab instead,
+ * and a TCB freed on another kernel thread is pushed back to the slab it came
+ * from without taking any lock.
+ *
+ * Every TCB starts on a cache line and is padded out to a whole number of
+ * them, so two threads running on different kernel threads never write to
+ * the same line through their TCBs.
+ *
+ * See the "Thread Control Block Slabs" section of README.md for where to call
+ * these from your scheduler.
+ */
+
+#ifndef TCB_SLAB_H
+#define TCB_SLAB_H
+
+#include <stddef.h>
+
+#define TCB_CACHE_LINE 64
+
+/* Set the size of a TCB, i.e. sizeof(struct thread). Call once from
+ * scheduler_begin, before the first tcb_alloc.
+ */
+void tcb_init(size_t tcb_size);
+
+/* Allocate a TCB from the calling kernel thread's slab. The TCB starts out
+ * with two references: one for the thread itself and one for its joiner.
+ */
+void * tcb_alloc(void);
+
+/* Drop one reference, and free the TCB if that was the last one. The TCB
+ * goes back to the slab it was allocated from, whichever kernel thread calls
+ * this. Free the thread's stack before dropping its reference, not after:
+ * the stack is not needed once the thread is DONE, and the TCB may be reused
+ * as soon as it is released.
+ */
+void tcb_release(void * tcb);
+
+/* Free a TCB regardless of its references, e.g. for a kernel thread's
+ * initial thread, which nobody joins.
+ */
+void tcb_free(void * tcb);
+
+#endif
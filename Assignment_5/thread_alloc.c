@@ -0,0 +1,336 @@
+/* CS533 Assignment 5
+ * thread_alloc.c: Memory allocation for user-level threads
+ *
+ * Memory is handed out in spans of SPAN_SIZE bytes, aligned to SPAN_SIZE, so
+ * the span a block came from is found by rounding its address down. A span
+ * starts with a header saying which heap it belongs to and which size class
+ * its blocks are; a block itself has no header at all. A block bigger than
+ * THREAD_ALLOC_MAX gets a mapping of its own, laid out the same way.
+ *
+ * There is one heap per CPU, found with sched_getcpu rather than by kernel
+ * thread ID like tcb_slab.c does: sched_getcpu does not enter the kernel,
+ * and gettid would cost more than the allocation itself. With pinned kernel
+ * threads (see affinity.h) it comes to the same thing. Since a kernel thread
+ * can move to another CPU at any time, two of them may end up using the same
+ * heap, so each heap has a spinlock, but it is only ever contended when that
+ * happens. Each heap keeps
+ *
+ *   free     a free list per size class, protected by the heap's lock
+ *   bump     the unused end of the last span of each size class
+ *   remote   blocks freed on other CPUs; a lock-free stack that anyone
+ *            pushes onto and the heap's users empty all at once, so there is
+ *            no ABA problem
+ *
+ * Spans come from regions of REGION_SPANS spans allocated with node_alloc,
+ * so they are first touched on the CPU whose heap they belong to. Memory is
+ * never returned to the system, except for large blocks.
+ *
+ * An arena is a list of chunks allocated with thread_alloc. Allocating from
+ * one is a fetch-and-add on the newest chunk; only a thread that finds it
+ * full takes the arena's lock to add another.
+ */
+
+#define _GNU_SOURCE
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "affinity.h"
+#include "thread_alloc.h"
+#include "scheduler.h"
+
+#define CACHE_LINE    64
+#define SPAN_SIZE     (256 * 1024)          /* power of 2 */
+#define SPAN_HEADER   CACHE_LINE            /* blocks start this far in */
+#define REGION_SPANS  16
+#define MIN_BLOCK     16
+#define NUM_CLASSES   12                    /* 16, 32, ... THREAD_ALLOC_MAX */
+#define MAX_HEAPS     256                   /* power of 2 */
+
+#define ARENA_CHUNK_SIZE THREAD_ALLOC_MAX
+#define ARENA_ALIGN      16
+
+struct block {
+  struct block * next;
+};
+
+struct heap;
+
+struct span {
+  struct heap * owner;
+  int cls;                       /* -1 for a large block */
+  size_t size;                   /* of a large block's mapping */
+};
+
+struct heap {
+  volatile AO_t remote;
+  char pad[CACHE_LINE - sizeof(AO_t)];
+  AO_TS_t lock;
+  struct block * free[NUM_CLASSES];
+  char * bump[NUM_CLASSES];
+  char * end[NUM_CLASSES];
+  char * spans, * spans_end;     /* unused part of the current region */
+};
+
+static volatile AO_t heaps[MAX_HEAPS];
+
+struct arena_chunk {
+  struct arena_chunk * next;
+  size_t size;                   /* bytes after the header */
+  volatile AO_t used;
+};
+
+#define CHUNK_HEADER ((sizeof(struct arena_chunk) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+struct arena {
+  volatile AO_t current;         /* newest chunk, with older ones after it */
+  AO_TS_t lock;
+};
+
+static int class_of(size_t size) {
+  int cls = 0;
+  while((size_t)(MIN_BLOCK << cls) < size) {
+    ++cls;
+  }
+  return cls;
+}
+
+static struct span * span_of(void * p) {
+  return (struct span *)((size_t)p & ~(size_t)(SPAN_SIZE - 1));
+}
+
+/* Map size bytes, aligned to SPAN_SIZE. size must be a multiple of the page
+ * size.
+ */
+static char * map_aligned(size_t size) {
+  char * raw = node_alloc(size + SPAN_SIZE);
+  if(!raw) {
+    return NULL;
+  }
+
+  char * p = (char *)(((size_t)raw + SPAN_SIZE - 1) & ~(size_t)(SPAN_SIZE - 1));
+  if(p > raw) {
+    node_free(raw, p - raw);
+  }
+  node_free(p + size, raw + SPAN_SIZE - p);
+  return p;
+}
+
+/* The heap of the CPU the calling kernel thread is running on, created on
+ * first use
+ */
+static struct heap * my_heap(void) {
+#ifdef UNIPROCESSOR
+  /* only one kernel thread, wherever it runs */
+  unsigned i = 0;
+#else
+  int cpu = sched_getcpu();
+  unsigned i = (cpu < 0 ? 0 : cpu) & (MAX_HEAPS - 1);
+#endif
+
+  struct heap * h = (struct heap *)AO_load_acquire(&heaps[i]);
+  if(h) {
+    return h;
+  }
+
+  h = node_alloc(sizeof(struct heap));
+  if(!h) {
+    perror("thread_alloc: node_alloc");
+    abort();
+  }
+  h->lock = AO_TS_INITIALIZER;
+  if(!AO_compare_and_swap_full(&heaps[i], 0, (AO_t)h)) {
+    node_free(h, sizeof(struct heap));
+    h = (struct heap *)AO_load_acquire(&heaps[i]);
+  }
+  return h;
+}
+
+/* Move the blocks other CPUs have freed onto h's free lists. Must hold h's
+ * lock.
+ */
+static void drain(struct heap * h) {
+  AO_t remote;
+  do {
+    remote = AO_load(&h->remote);
+  } while(remote && !AO_compare_and_swap_full(&h->remote, remote, 0));
+
+  struct block * b = (struct block *)remote;
+  while(b) {
+    struct block * next = b->next;
+    int cls = span_of(b)->cls;
+    b->next = h->free[cls];
+    h->free[cls] = b;
+    b = next;
+  }
+}
+
+/* Must hold h's lock */
+static struct span * new_span(struct heap * h) {
+  if(h->spans == h->spans_end) {
+    h->spans = map_aligned(REGION_SPANS * SPAN_SIZE);
+    if(!h->spans) {
+      h->spans_end = NULL;
+      return NULL;
+    }
+    h->spans_end = h->spans + REGION_SPANS * SPAN_SIZE;
+  }
+
+  struct span * s = (struct span *)h->spans;
+  h->spans += SPAN_SIZE;
+  return s;
+}
+
+/* Must hold h's lock */
+static void * alloc_small(struct heap * h, int cls) {
+  struct block * b = h->free[cls];
+  if(!b && AO_load(&h->remote)) {
+    drain(h);
+    b = h->free[cls];
+  }
+  if(b) {
+    h->free[cls] = b->next;
+    return b;
+  }
+
+  size_t size = MIN_BLOCK << cls;
+  if((size_t)(h->end[cls] - h->bump[cls]) < size) {
+    struct span * s = new_span(h);
+    if(!s) {
+      return NULL;
+    }
+    s->owner = h;
+    s->cls = cls;
+    h->bump[cls] = (char *)s + SPAN_HEADER;
+    h->end[cls] = (char *)s + SPAN_SIZE;
+  }
+
+  void * p = h->bump[cls];
+  h->bump[cls] += size;
+  return p;
+}
+
+static void * alloc_large(size_t size) {
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t total = (SPAN_HEADER + size + page - 1) & ~(page - 1);
+
+  struct span * s = (struct span *)map_aligned(total);
+  if(!s) {
+    return NULL;
+  }
+  s->owner = NULL;
+  s->cls = -1;
+  s->size = total;
+  return (char *)s + SPAN_HEADER;
+}
+
+void * thread_alloc(size_t size) {
+  if(size > THREAD_ALLOC_MAX) {
+    return alloc_large(size);
+  }
+
+  struct heap * h = my_heap();
+  spinlock_lock(&h->lock);
+  void * p = alloc_small(h, class_of(size));
+  spinlock_unlock(&h->lock);
+  return p;
+}
+
+void thread_free(void * p) {
+  if(!p) {
+    return;
+  }
+
+  struct span * s = span_of(p);
+  if(s->cls < 0) {
+    node_free(s, s->size);
+    return;
+  }
+
+  struct heap * h = s->owner;
+  struct block * b = p;
+
+  if(h == my_heap()) {
+    spinlock_lock(&h->lock);
+    b->next = h->free[s->cls];
+    h->free[s->cls] = b;
+    spinlock_unlock(&h->lock);
+    return;
+  }
+
+  AO_t old;
+  do {
+    old = AO_load(&h->remote);
+    b->next = (struct block *)old;
+  } while(!AO_compare_and_swap_full(&h->remote, old, (AO_t)b));
+}
+
+arena_t * arena_create(void) {
+  arena_t * a = thread_alloc(sizeof(arena_t));
+  if(a) {
+    a->current = 0;
+    a->lock = AO_TS_INITIALIZER;
+  }
+  return a;
+}
+
+void * arena_alloc(arena_t * a, size_t size) {
+  size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+  while(1) {
+    struct arena_chunk * c = (struct arena_chunk *)AO_load_acquire(&a->current);
+    if(c) {
+      AO_t off = AO_fetch_and_add_full(&c->used, size);
+      if(off + size <= c->size) {
+        return (char *)c + CHUNK_HEADER + off;
+      }
+    }
+
+    spinlock_lock(&a->lock);
+    if(AO_load(&a->current) != (AO_t)c) {
+      /* somebody else added a chunk in the meantime */
+      spinlock_unlock(&a->lock);
+      continue;
+    }
+
+    size_t room = ARENA_CHUNK_SIZE - CHUNK_HEADER;
+    struct arena_chunk * n = thread_alloc(CHUNK_HEADER + (size > room ? size : room));
+    if(!n) {
+      spinlock_unlock(&a->lock);
+      return NULL;
+    }
+
+    if(size > room) {
+      /* a chunk of its own, behind the current one so that the rest of
+       * the current one still gets used */
+      n->size = size;
+      n->used = size;
+      if(c) {
+        n->next = c->next;
+        c->next = n;
+      } else {
+        n->next = NULL;
+        AO_store_release(&a->current, (AO_t)n);
+      }
+      spinlock_unlock(&a->lock);
+      return (char *)n + CHUNK_HEADER;
+    }
+
+    n->next = c;
+    n->size = room;
+    n->used = 0;
+    AO_store_release(&a->current, (AO_t)n);
+    spinlock_unlock(&a->lock);
+  }
+}
+
+void arena_destroy(arena_t * a) {
+  struct arena_chunk * c = (struct arena_chunk *)a->current;
+  while(c) {
+    struct arena_chunk * next = c->next;
+    thread_free(c);
+    c = next;
+  }
+  thread_free(a);
+}
@@ -0,0 +1,42 @@
+/* CS533 Assignment 5
+ * thread_alloc.h: Memory allocation for user-level threads
+ *
+ * With safe_mem, every malloc and free in the program takes the same
+ * spinlock, whichever kernel thread it is running on. thread_alloc and
+ * thread_free keep a cache of free blocks for every size class on every CPU
+ * instead, so two kernel threads on different CPUs never wait for each
+ * other. A block freed on a different CPU from the one it was allocated on
+ * goes back to its own cache through a lock-free queue.
+ *
+ * An arena is for memory that is all freed at the same time, such as
+ * everything allocated inside a fork/join region: arena_alloc bumps a
+ * pointer, and arena_destroy frees it all at once. Any number of threads, on
+ * any kernel threads, may allocate from the same arena.
+ *
+ * See the "Thread Allocator" section of README.md.
+ */
+
+#ifndef THREAD_ALLOC_H
+#define THREAD_ALLOC_H
+
+#include <stddef.h>
+
+/* Blocks of up to this many bytes come from the size-class caches; larger
+ * ones are mapped and unmapped one at a time.
+ */
+#define THREAD_ALLOC_MAX (32 * 1024)
+
+void * thread_alloc(size_t size);
+void thread_free(void * p);
+
+typedef struct arena arena_t;
+
+arena_t * arena_create(void);
+void * arena_alloc(arena_t * arena, size_t size);
+
+/* Free the arena and everything allocated from it. Nothing may be allocating
+ * from it any more, e.g. because all the threads that used it were joined.
+ */
+void arena_destroy(arena_t * arena);
+
+#endif
@@ -0,0 +1,89 @@
+/* CS533 Assignment 5
+ * thread_key.c: Thread-specific data for user-level threads
+ *
+ * num_keys only grows, so creating a key takes no lock. A key is reserved
+ * by bumping next_key, and only counted in num_keys once its destructor is
+ * stored, so that a thread exiting in between cannot see the key without
+ * its destructor. Keys are counted in the order they were reserved; nothing
+ * yields between reserving and counting one, so the wait for an earlier
+ * key is short. thread_specific_exit only looks at the first num_keys
+ * values of a TCB. thread_specific_init clears all of them, though: a key
+ * may be created while the thread is running, and a TCB from a slab still
+ * holds the last thread's values.
+ *
+ * A deleted key keeps its slot, with its destructor set to NULL, so nothing
+ * can ever see another key's stale value.
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include "scheduler.h"
+#include "thread_key.h"
+
+#ifdef THREAD_KEYS
+
+static volatile AO_t next_key;          /* reserved */
+static volatile AO_t num_keys;          /* reserved, with destructors set */
+static void (* volatile destructors[THREAD_KEYS_MAX])(void *);
+
+int thread_key_create(thread_key_t * key, void (*destructor)(void *)) {
+  AO_t k;
+
+  do {
+    k = AO_load_acquire(&next_key);
+    if(k >= THREAD_KEYS_MAX) {
+      return EAGAIN;
+    }
+  } while(!AO_compare_and_swap_full(&next_key, k, k + 1));
+
+  destructors[k] = destructor;
+  while(!AO_compare_and_swap_full(&num_keys, k, k + 1)) {
+  }
+  *key = (thread_key_t)k;
+  return 0;
+}
+
+int thread_key_delete(thread_key_t key) {
+  if(key < 0 || (AO_t)key >= AO_load_acquire(&num_keys)) {
+    return EINVAL;
+  }
+  destructors[key] = NULL;
+  return 0;
+}
+
+void * thread_getspecific(thread_key_t key) {
+  return current_thread->specific.values[key];
+}
+
+int thread_setspecific(thread_key_t key, const void * value) {
+  if(key < 0 || (AO_t)key >= AO_load_acquire(&num_keys)) {
+    return EINVAL;
+  }
+  current_thread->specific.values[key] = (void *)value;
+  return 0;
+}
+
+void thread_specific_init(struct thread_specific * specific) {
+  memset(specific->values, 0, sizeof(specific->values));
+}
+
+void thread_specific_exit(struct thread_specific * specific) {
+  int i, k, n, again = 1;
+
+  for(i = 0; again && i < THREAD_DESTRUCTOR_ITERATIONS; ++i) {
+    again = 0;
+    n = AO_load_acquire(&num_keys);
+    for(k = 0; k < n; ++k) {
+      void * value = specific->values[k];
+      void (*destructor)(void *) = destructors[k];
+      if(value && destructor) {
+        specific->values[k] = NULL;
+        destructor(value);
+        again = 1;
+      }
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,53 @@
+/* CS533 Assignment 5
+ * thread_key.h: Thread-specific data for user-level threads
+ *
+ * pthread_getspecific does not work for user-level threads: every user-level
+ * thread on a kernel thread would see the same values. Here each thread's
+ * values live in its TCB, in a struct thread_specific, so that a lookup is
+ * current_thread plus one load.
+ *
+ * Keys are handed out in order and never reused, so a process gets
+ * THREAD_KEYS_MAX of them in all; thread_key_delete only stops the key's
+ * destructor from running. When a thread's initial function returns, the
+ * destructor of every key for which the thread has a value other than NULL
+ * is called with that value, after the value is set to NULL. If destructors
+ * set values again, this repeats, up to THREAD_DESTRUCTOR_ITERATIONS times.
+ *
+ * See the "Thread-Specific Data" section of README.md for what to add to
+ * your scheduler; this file is only compiled if scheduler.h defines
+ * THREAD_KEYS.
+ */
+
+#ifndef THREAD_KEY_H
+#define THREAD_KEY_H
+
+#define THREAD_KEYS_MAX               32
+#define THREAD_DESTRUCTOR_ITERATIONS  4
+
+typedef int thread_key_t;
+
+/* Goes in struct thread, as a field called specific */
+struct thread_specific {
+  void * values[THREAD_KEYS_MAX];
+};
+
+/* 0 on success, or EAGAIN once all THREAD_KEYS_MAX keys have been created.
+ * destructor may be NULL. */
+int thread_key_create(thread_key_t * key, void (*destructor)(void *));
+
+/* 0 on success, or EINVAL if key was never created */
+int thread_key_delete(thread_key_t key);
+
+/* The current thread's value for key; NULL if it has not set one */
+void * thread_getspecific(thread_key_t key);
+
+/* 0 on success, or EINVAL if key was never created */
+int thread_setspecific(thread_key_t key, const void * value);
+
+/* Called by the scheduler: thread_specific_init on every new TCB, and
+ * thread_specific_exit from the thread itself once its initial function
+ * has returned. */
+void thread_specific_init(struct thread_specific * specific);
+void thread_specific_exit(struct thread_specific * specific);
+
+#endif
@@ -0,0 +1,41 @@
+/* CS533 Assignment 5
+ * uniproc.h: Single-kernel-thread build of the runtime
+ *
+ * Compiled with -DUNIPROCESSOR (see the benchmark_up target in the Makefile),
+ * the runtime runs on exactly one kernel thread, the one that called
+ * scheduler_begin. Then nothing needs protecting from another kernel thread:
+ * spinlocks do nothing, current_thread is a global variable rather than a
+ * lookup by kernel thread ID, and the uniproc/atomic_ops.h that the build
+ * uses instead of libatomic_ops turns atomic operations into plain loads and
+ * stores. Without UNIPROCESSOR, this file defines nothing.
+ *
+ * Include it from scheduler.h; see the "Uniprocessor Build" section of
+ * README.md for the rest of the changes.
+ */
+
+#ifndef UNIPROC_H
+#define UNIPROC_H
+
+#ifdef UNIPROCESSOR
+
+#include <atomic_ops.h>
+
+struct thread;
+
+/* defined in uniproc/threadmap.c */
+extern struct thread * uniproc_current_thread;
+
+#define get_current_thread()  (uniproc_current_thread)
+#define set_current_thread(t) ((void)(uniproc_current_thread = (t)))
+
+static inline void spinlock_lock(AO_TS_t * lock) {
+  (void)lock;
+}
+
+static inline void spinlock_unlock(AO_TS_t * lock) {
+  (void)lock;
+}
+
+#endif
+
+#endif
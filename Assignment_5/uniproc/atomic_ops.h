@@ -0,0 +1,108 @@
+/* CS533 Assignment 5
+ * uniproc/atomic_ops.h: libatomic_ops for a single kernel thread
+ *
+ * The uniprocessor build puts this directory ahead of libatomic_ops on the
+ * include path, so that every #include <atomic_ops.h> gets this file
+ * instead. With one kernel thread, a user-level thread only ever loses the
+ * CPU inside a call to the scheduler, so none of these operations needs to
+ * be atomic: each is a plain load or store, and the ones that order memory
+ * are only compiler barriers, which cost nothing at run time.
+ *
+ * Only the operations the runtime uses are here. Do not use this for
+ * anything shared with another kernel thread; on x86, memory shared with the
+ * kernel itself (such as an io_uring) is still fine.
+ */
+
+#ifndef UNIPROC_ATOMIC_OPS_H
+#define UNIPROC_ATOMIC_OPS_H
+
+#include <stddef.h>
+
+typedef size_t AO_t;
+
+typedef enum { AO_TS_CLEAR = 0, AO_TS_SET = 1 } AO_TS_VAL_t;
+typedef volatile unsigned char AO_TS_t;
+#define AO_TS_INITIALIZER AO_TS_CLEAR
+
+#define AO_compiler_barrier() __asm__ __volatile__("" : : : "memory")
+
+static inline AO_TS_VAL_t AO_test_and_set_acquire(AO_TS_t * p) {
+  AO_TS_VAL_t old = (AO_TS_VAL_t)*p;
+  *p = AO_TS_SET;
+  AO_compiler_barrier();
+  return old;
+}
+#define AO_test_and_set_full(p) AO_test_and_set_acquire(p)
+
+#define AO_CLEAR(p) do { AO_compiler_barrier(); *(p) = AO_TS_CLEAR; } while(0)
+
+static inline void AO_nop_full(void) {
+  AO_compiler_barrier();
+}
+
+static inline AO_t AO_load(const volatile AO_t * p) {
+  return *p;
+}
+
+static inline AO_t AO_load_acquire(const volatile AO_t * p) {
+  AO_t v = *p;
+  AO_compiler_barrier();
+  return v;
+}
+
+static inline void AO_store(volatile AO_t * p, AO_t v) {
+  *p = v;
+}
+
+static inline void AO_store_release(volatile AO_t * p, AO_t v) {
+  AO_compiler_barrier();
+  *p = v;
+}
+#define AO_store_full(p, v) AO_store_release(p, v)
+
+static inline AO_t AO_fetch_and_add(volatile AO_t * p, AO_t incr) {
+  AO_t old = *p;
+  *p = old + incr;
+  return old;
+}
+#define AO_fetch_and_add_full(p, incr) AO_fetch_and_add(p, incr)
+#define AO_fetch_and_add1(p)           AO_fetch_and_add(p, 1)
+#define AO_fetch_and_add1_full(p)      AO_fetch_and_add(p, 1)
+#define AO_fetch_and_sub1(p)           AO_fetch_and_add(p, (AO_t)-1)
+#define AO_fetch_and_sub1_full(p)      AO_fetch_and_add(p, (AO_t)-1)
+
+static inline int AO_compare_and_swap(volatile AO_t * p, AO_t old, AO_t new_val) {
+  if(*p != old) {
+    return 0;
+  }
+  *p = new_val;
+  return 1;
+}
+#define AO_compare_and_swap_full(p, old, new_val)    AO_compare_and_swap(p, old, new_val)
+#define AO_compare_and_swap_acquire(p, old, new_val) AO_compare_and_swap(p, old, new_val)
+#define AO_compare_and_swap_release(p, old, new_val) AO_compare_and_swap(p, old, new_val)
+
+static inline unsigned AO_int_load(const volatile unsigned * p) {
+  return *p;
+}
+
+static inline unsigned AO_int_load_acquire(const volatile unsigned * p) {
+  unsigned v = *p;
+  AO_compiler_barrier();
+  return v;
+}
+
+static inline void AO_int_store(volatile unsigned * p, unsigned v) {
+  *p = v;
+}
+
+static inline void AO_int_store_release(volatile unsigned * p, unsigned v) {
+  AO_compiler_barrier();
+  *p = v;
+}
+
+static inline unsigned AO_int_fetch_and_add1(volatile unsigned * p) {
+  return (*p)++;
+}
+
+#endif
@@ -0,0 +1,11 @@
+/* CS533 Assignment 5
+ * uniproc/threadmap.c: threadmap.c for a single kernel thread
+ *
+ * The uniprocessor build links this in place of threadmap.c. With one kernel
+ * thread there is nothing to look up; uniproc.h turns get_current_thread and
+ * set_current_thread into uses of this variable.
+ */
+
+#include "scheduler.h"
+
+struct thread * uniproc_current_thread;
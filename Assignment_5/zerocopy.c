@@ -0,0 +1,321 @@
+/* CS533 Assignment 5
+ * zerocopy.c: sendfile, splice and tee for user-level threads
+ *
+ * A thread that gets EAGAIN parks on its descriptor's state, the same way
+ * barrier_wait parks on a barrier, and the poller kernel thread wakes it:
+ *
+ *   thread                                 poller
+ *     call fails with EAGAIN                 epoll_wait returns fd
+ *     lock fd.lock                           lock fd.lock
+ *     nothing in fd.ready yet                fd.ready |= events
+ *     add self to fd.waiters                 take fd.waiters
+ *     state = BLOCKED                        unlock fd.lock
+ *     block(&fd.lock)                        unblock each waiter
+ *     try the call again
+ *
+ * Descriptors are registered with EPOLLET, so epoll reports each change of
+ * state once, and fd.ready remembers it until a thread looks. A thread that
+ * finds the bit it waits for already set clears it and tries again, rather
+ * than parking; if the call fails again, the next change will set the bit
+ * again. That edge may have been used up by another thread that then left
+ * the descriptor ready, though, such as one of two readers that made a short
+ * read, so before parking a thread also polls the descriptor itself, with
+ * fd.lock held so that no new edge can slip in between. Waiter entries live
+ * on the waiting threads' stacks.
+ *
+ * A descriptor's state is made the first time it is used, and kept for good,
+ * so that the poller never sees one that has been freed. close_wrap only
+ * takes the descriptor out of the epoll set, and the next descriptor with
+ * the same number is registered again.
+ *
+ * The poller is a kernel thread of its own, which never runs user-level
+ * threads, so it must not touch current_thread.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+
+#include "affinity.h"
+#include "cmap.h"
+#include "scheduler.h"
+#include "zerocopy.h"
+
+#define POLLER_STACK_SIZE (64 * 1024)
+
+#define CLONE_FLAGS (CLONE_THREAD | CLONE_VM | CLONE_SIGHAND | \
+                     CLONE_FILES | CLONE_FS | CLONE_IO)
+
+typedef enum {
+  UNREGISTERED,
+  POLLED,                        /* non-blocking, and in the epoll set */
+  ALWAYS_READY                   /* a regular file, which never blocks */
+} fd_mode_t;
+
+struct fd_waiter {
+  struct thread * t;
+  struct fd_waiter * next;
+};
+
+struct fd_state {
+  AO_TS_t lock;
+  int fd;
+  fd_mode_t mode;
+  int ready;                     /* POLL* events not looked at yet */
+  struct fd_waiter * waiters;
+};
+
+static volatile AO_t initialized;       /* 1 while starting, 2 once done */
+static cmap_t * fds;                    /* fd + 1 -> struct fd_state */
+static AO_TS_t fds_lock = AO_TS_INITIALIZER;
+static int epfd = -1;                   /* -1: wait by polling and yielding */
+
+#ifndef UNIPROCESSOR
+static int poller(void * arg) {
+  struct epoll_event events[ZEROCOPY_EVENTS];
+  int i, n;
+
+  while(1) {
+    n = epoll_wait(epfd, events, ZEROCOPY_EVENTS, -1);
+    for(i = 0; i < n; ++i) {
+      struct fd_state * st = events[i].data.ptr;
+      int ready = events[i].events & (POLLIN | POLLOUT | POLLERR | POLLHUP);
+      if(events[i].events & EPOLLRDHUP) {
+        ready |= POLLIN;
+      }
+
+      spinlock_lock(&st->lock);
+      st->ready |= ready;
+      struct fd_waiter * w = st->waiters;
+      st->waiters = NULL;
+      spinlock_unlock(&st->lock);
+
+      while(w) {
+        struct fd_waiter * next = w->next;
+        unblock(w->t);
+        w = next;
+      }
+    }
+  }
+  return 0;
+}
+#endif
+
+/* Set up the map, and the poller unless there must only be one kernel
+ * thread. The first thread to get here does it; any others yield until it
+ * is done. */
+static void zerocopy_init(void) {
+  if(AO_load_acquire(&initialized) == 2) {
+    return;
+  }
+  if(!AO_compare_and_swap_full(&initialized, 0, 1)) {
+    while(AO_load_acquire(&initialized) != 2) {
+      yield();
+    }
+    return;
+  }
+
+  fds = cmap_create(64);
+#ifndef UNIPROCESSOR
+  char * stack = node_alloc(POLLER_STACK_SIZE);
+  epfd = epoll_create1(EPOLL_CLOEXEC);
+  if(epfd < 0 || !stack ||
+     clone(poller, stack + POLLER_STACK_SIZE, CLONE_FLAGS, NULL) < 0) {
+    perror("zerocopy: poller");
+    epfd = -1;
+  }
+#endif
+  AO_store_release(&initialized, 2);
+}
+
+/* Make fd non-blocking and add it to the epoll set, with st->lock held */
+static int fd_register(struct fd_state * st) {
+  struct stat sb;
+  int flags;
+
+  if(fstat(st->fd, &sb) < 0) {
+    return -1;
+  }
+  if(S_ISREG(sb.st_mode) || S_ISDIR(sb.st_mode) || S_ISBLK(sb.st_mode)) {
+    st->mode = ALWAYS_READY;
+    return 0;
+  }
+
+  if((flags = fcntl(st->fd, F_GETFL)) < 0 ||
+     (!(flags & O_NONBLOCK) && fcntl(st->fd, F_SETFL, flags | O_NONBLOCK) < 0)) {
+    return -1;
+  }
+  if(epfd >= 0) {
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    ev.data.ptr = st;
+    if(epoll_ctl(epfd, EPOLL_CTL_ADD, st->fd, &ev) < 0) {
+      /* epoll refuses descriptors that are always ready */
+      st->mode = errno == EPERM ? ALWAYS_READY : UNREGISTERED;
+      return errno == EPERM ? 0 : -1;
+    }
+  }
+  st->ready = 0;
+  st->mode = POLLED;
+  return 0;
+}
+
+/* fd's state, registered; NULL with errno set if fd is not open */
+static struct fd_state * fd_state(int fd) {
+  struct fd_state * st;
+
+  if(fd < 0) {
+    errno = EBADF;
+    return NULL;
+  }
+  zerocopy_init();
+
+  if(!(st = cmap_get(fds, fd + 1))) {
+    spinlock_lock(&fds_lock);
+    if(!(st = cmap_get(fds, fd + 1))) {
+      st = malloc(sizeof(struct fd_state));
+      st->lock = AO_TS_INITIALIZER;
+      st->fd = fd;
+      st->mode = UNREGISTERED;
+      st->ready = 0;
+      st->waiters = NULL;
+      cmap_put(fds, fd + 1, st);
+    }
+    spinlock_unlock(&fds_lock);
+  }
+
+  if(st->mode == UNREGISTERED) {
+    int result;
+    spinlock_lock(&st->lock);
+    result = st->mode == UNREGISTERED ? fd_register(st) : 0;
+    spinlock_unlock(&st->lock);
+    if(result < 0) {
+      return NULL;
+    }
+  }
+  return st;
+}
+
+int fd_wait(int fd, int events) {
+  struct fd_state * st = fd_state(fd);
+  struct fd_waiter me;
+
+  if(!st) {
+    return -1;
+  }
+  if(st->mode == ALWAYS_READY) {
+    return 0;
+  }
+
+  if(epfd < 0) {
+    struct pollfd p = { fd, events, 0 };
+    while(poll(&p, 1, 0) == 0) {
+      yield();
+    }
+    return 0;
+  }
+
+  spinlock_lock(&st->lock);
+  if(st->ready & (events | POLLERR | POLLHUP)) {
+    st->ready &= ~events;
+    spinlock_unlock(&st->lock);
+    return 0;
+  }
+  struct pollfd p = { fd, events, 0 };
+  if(poll(&p, 1, 0) != 0) {
+    spinlock_unlock(&st->lock);
+    return 0;
+  }
+  me.t = current_thread;
+  me.next = st->waiters;
+  st->waiters = &me;
+  current_thread->state = BLOCKED;
+  block(&st->lock);
+  return 0;
+}
+
+/* After EAGAIN from a call from in to out: wait for whichever is not ready */
+static int wait_either(int in, int out) {
+  struct pollfd p[2] = { { in, POLLIN, 0 }, { out, POLLOUT, 0 } };
+
+  if(poll(p, 2, 0) < 0) {
+    return -1;
+  }
+  if(!p[0].revents) {
+    return fd_wait(in, POLLIN);
+  }
+  if(!p[1].revents) {
+    return fd_wait(out, POLLOUT);
+  }
+  yield();                       /* both ready again already */
+  return 0;
+}
+
+ssize_t sendfile_wrap(int out_fd, int in_fd, off_t * offset, size_t count) {
+  ssize_t n;
+
+  if(!fd_state(in_fd) || !fd_state(out_fd)) {
+    return -1;
+  }
+  while((n = sendfile(out_fd, in_fd, offset, count)) < 0 && errno == EAGAIN) {
+    if(wait_either(in_fd, out_fd) < 0) {
+      return -1;
+    }
+  }
+  return n;
+}
+
+ssize_t splice_wrap(int fd_in, loff_t * off_in, int fd_out, loff_t * off_out,
+                    size_t len, unsigned int flags) {
+  ssize_t n;
+
+  if(!fd_state(fd_in) || !fd_state(fd_out)) {
+    return -1;
+  }
+  while((n = splice(fd_in, off_in, fd_out, off_out, len,
+                    flags | SPLICE_F_NONBLOCK)) < 0 && errno == EAGAIN) {
+    if(wait_either(fd_in, fd_out) < 0) {
+      return -1;
+    }
+  }
+  return n;
+}
+
+ssize_t tee_wrap(int fd_in, int fd_out, size_t len, unsigned int flags) {
+  ssize_t n;
+
+  if(!fd_state(fd_in) || !fd_state(fd_out)) {
+    return -1;
+  }
+  while((n = tee(fd_in, fd_out, len, flags | SPLICE_F_NONBLOCK)) < 0 &&
+        errno == EAGAIN) {
+    if(wait_either(fd_in, fd_out) < 0) {
+      return -1;
+    }
+  }
+  return n;
+}
+
+int close_wrap(int fd) {
+  struct fd_state * st;
+
+  if(fd >= 0 && AO_load_acquire(&initialized) == 2 &&
+     (st = cmap_get(fds, fd + 1))) {
+    spinlock_lock(&st->lock);
+    if(st->mode == POLLED && epfd >= 0) {
+      epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+    }
+    st->mode = UNREGISTERED;
+    st->ready = 0;
+    spinlock_unlock(&st->lock);
+  }
+  return close(fd);
+}
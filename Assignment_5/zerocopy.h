@@ -0,0 +1,63 @@
+/* CS533 Assignment 5
+ * zerocopy.h: sendfile, splice and tee for user-level threads
+ *
+ * Serving a file with read_wrap and write copies every byte twice, from the
+ * page cache into a buffer and from the buffer into the socket, and makes
+ * two system calls per buffer. sendfile, splice and tee move the data
+ * between file descriptors inside the kernel instead. The wrappers here
+ * have the same signatures and results as the system calls, but block only
+ * the calling user-level thread: when a call would block, the thread is
+ * parked until the descriptor it is waiting for is ready, and the other
+ * threads keep running in the meantime.
+ *
+ * Every descriptor other than a regular file is switched to non-blocking
+ * mode the first time it is passed to one of these functions, and stays
+ * that way; splice_wrap and tee_wrap add SPLICE_F_NONBLOCK themselves. A
+ * call returns as soon as it has moved any data, or on an error, the way
+ * the system call on a blocking descriptor would. A descriptor that is also
+ * read or written directly, before it has been passed to one of them, must
+ * be made non-blocking by its creator (SOCK_NONBLOCK, pipe2 with
+ * O_NONBLOCK), or that call blocks the whole kernel thread. For the
+ * SPLICE_F_ flags, define _GNU_SOURCE and include <fcntl.h>.
+ *
+ * Parked threads are woken up by a kernel thread of this module's own,
+ * which waits for every registered descriptor with epoll, cloned the first
+ * time a descriptor is used. The descriptors are kept in a cmap_t, keyed by
+ * descriptor. In the uniprocessor build, where there must only be one
+ * kernel thread, a waiting thread yields and polls instead.
+ *
+ * See the "Zero-Copy Transfers" section of README.md.
+ */
+
+#ifndef ZEROCOPY_H
+#define ZEROCOPY_H
+
+#include <sys/types.h>
+
+/* Events fetched by one epoll_wait */
+#define ZEROCOPY_EVENTS 64
+
+ssize_t sendfile_wrap(int out_fd, int in_fd, off_t * offset, size_t count);
+ssize_t splice_wrap(int fd_in, loff_t * off_in, int fd_out, loff_t * off_out,
+                    size_t len, unsigned int flags);
+ssize_t tee_wrap(int fd_in, int fd_out, size_t len, unsigned int flags);
+
+/* Park the calling thread until fd is ready for events (POLLIN, POLLOUT or
+ * both), after a call on it failed with EAGAIN. Also switches fd to
+ * non-blocking mode, like the wrappers. May return early; call it in a
+ * loop around the operation. Returns 0, or -1 if fd is not open.
+ *
+ * Have only one thread at a time wait on each descriptor for each direction.
+ * Several can, and none is left parked while the descriptor is ready, but
+ * every change wakes all of them to race for it, and the losers make another
+ * system call each before they park again.
+ */
+int fd_wait(int fd, int events);
+
+/* Forget fd, then close it. Use it in place of close for any descriptor
+ * passed to the functions above, or a new descriptor with the same number
+ * would never be woken up. No thread may be waiting for fd.
+ */
+int close_wrap(int fd);
+
+#endif